@@ -0,0 +1,538 @@
+/* comport-bench - headless throughput/latency benchmark for [comport]
+
+   comport.c is linked against pdstub (a minimal stand-in for Pd's API) and
+   talks to the slave side of a pseudo terminal; a "device" thread plays the
+   other end on the master side.  every test runs for each combination of
+   iomode, baud rate and pollintervall and writes one CSV line:
+
+     rx     the device sends a counter at the baud rate (8N1 timing), the
+            bytes come out of the left outlet one float each
+     tx     the patch sends lists of counter bytes at the baud rate, the
+            device checks what arrives
+     echo   the device sends single bytes, the patch sends each one straight
+            back: latency is the round trip device -> outlet -> device
+     flood  like rx, but unpaced and without waiting for real time, to get
+            the maximum rate and the CPU cost per byte of the outlet path
+
+   latencies are in microseconds, cpu_ns_per_byte is the CPU time of the
+   Pd thread (the scheduler, clock callbacks and outlets) per byte, dropped
+   is what was sent but never arrived (plus what [comport] reports as
+   txdropped).  a pty has no line rate, so the baud rate only sets the pace
+   of the sender.
+
+   usage: comport-bench [-d seconds] [-m iomodes] [-b bauds] [-p intervals]
+                        [-t tests] [-l label] [-o file.csv] [-v]
+   lists are comma separated, e.g. -m poll,event -b 9600,115200
+*/
+
+#define _GNU_SOURCE
+#include "m_pd.h"
+#include "pdstub.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+
+void comport_setup(void);
+
+#define BENCH_TICK (64. * 1000. / 44100.) /* Pd's default scheduler block */
+#define BENCH_MAXLIST 1024                /* bytes per list in the tx test */
+#define BENCH_DRAIN 0.2                   /* seconds to wait for stragglers */
+
+enum { TEST_RX, TEST_TX, TEST_ECHO, TEST_FLOOD, TEST_COUNT };
+static const char *test_names[TEST_COUNT] = { "rx", "tx", "echo", "flood" };
+
+typedef struct _bench
+{
+    /* setup */
+    int test;
+    const char *iomode;
+    int baud;
+    int pollintervall;
+    double duration;
+    double end; /* nothing new is sent after this */
+
+    /* the pty */
+    int master;
+    char slave[256];
+
+    /* the [comport] */
+    t_pd *comport;
+    int open;
+    double txdropped;
+
+    /* device thread */
+    pthread_t thread;
+    int stop;
+
+    /* counters: 'sent' is written by the sending side, 'received' by the
+       receiving side; stamps[i] is when byte i was sent (rx and tx only) */
+    double *stamps;
+    long capacity;
+    long sent;
+    long received;
+    long misordered;
+    double *latency;
+    long nlatency;
+    double t_first, t_last;
+} t_bench;
+
+static t_bench bench;
+static int verbose;
+
+/* ------------------------------ helpers ------------------------------ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static double thread_cputime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int stopped(void)
+{
+    return __atomic_load_n(&bench.stop, __ATOMIC_ACQUIRE);
+}
+
+static long count(long *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+}
+
+static void set_count(long *counter, long n)
+{
+    __atomic_store_n(counter, n, __ATOMIC_RELEASE);
+}
+
+static void add_latency(double seconds)
+{
+    if(bench.latency && bench.nlatency < bench.capacity)
+        bench.latency[bench.nlatency++] = seconds * 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, long n, double p)
+{
+    long i;
+    if(n <= 0)
+        return -1;
+    i = (long)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+/* a list like "poll,event" -> array of strings */
+static int split(char *s, const char **out, int max)
+{
+    int n = 0;
+    char *tok, *save = 0;
+    for(tok = strtok_r(s, ",", &save); tok && n < max; tok = strtok_r(0, ",", &save))
+        out[n++] = tok;
+    return n;
+}
+
+/* --------------------------------- pty ------------------------------- */
+
+static int pty_open(void)
+{
+    const char *name;
+    struct termios tio;
+
+    bench.master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(bench.master < 0 || grantpt(bench.master) || unlockpt(bench.master)
+        || !(name = ptsname(bench.master)))
+    {
+        perror("comport-bench: pty");
+        return 0;
+    }
+    snprintf(bench.slave, sizeof(bench.slave), "%s", name);
+    /* [comport] configures the slave; the master just has to be raw */
+    if(tcgetattr(bench.master, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(bench.master, TCSANOW, &tio);
+    }
+    fcntl(bench.master, F_SETFL, fcntl(bench.master, F_GETFL) | O_NONBLOCK);
+    return 1;
+}
+
+/* ------------------------------ outlets ------------------------------ */
+
+static void outlet_hook(void *user, t_object *owner, int outlet,
+    t_symbol *s, int argc, t_atom *argv)
+{
+    (void)user; (void)owner;
+    if(outlet == 1)
+    {
+        if(argc < 1)
+            return;
+        if(!strcmp(s->s_name, "open"))
+            bench.open = atom_getint(argv);
+        else if(!strcmp(s->s_name, "txdropped"))
+            bench.txdropped = atom_getfloat(argv);
+        return;
+    }
+    if(outlet != 0 || s != &s_float || argc != 1)
+        return;
+
+    if(bench.test == TEST_ECHO)
+    {
+        pdstub_send(bench.comport, "float", 1, argv);
+        return;
+    }
+    /* rx, flood: the counter arrives here */
+    if(atom_getint(argv) != (bench.received & 0xff))
+        bench.misordered++;
+    if(bench.stamps && bench.received < bench.capacity)
+        add_latency(now() - bench.stamps[bench.received]);
+    set_count(&bench.received, bench.received + 1);
+    bench.t_last = now();
+}
+
+/* ---------------------------- device side ---------------------------- */
+
+/* send the counter at the baud rate (or as fast as possible for flood) */
+static void *device_send(void *dummy)
+{
+    unsigned char buf[4096];
+    double bytes_per_sec = bench.baud / 10.;
+    double start = now();
+    (void)dummy;
+
+    while(!stopped() && bench.sent < bench.capacity && now() < bench.end)
+    {
+        long due = bench.capacity, n, i;
+        ssize_t res;
+        double t = now();
+
+        if(bench.test == TEST_RX)
+        {
+            due = (long)((t - start) * bytes_per_sec);
+            if(due > bench.capacity)
+                due = bench.capacity;
+        }
+        n = due - bench.sent;
+        if(n > (long)sizeof(buf))
+            n = sizeof(buf);
+        if(n > 0)
+        {
+            for(i = 0; i < n; i++)
+                buf[i] = (bench.sent + i) & 0xff;
+            if(bench.stamps)
+                for(i = 0; i < n; i++)
+                    bench.stamps[bench.sent + i] = t;
+            res = write(bench.master, buf, n);
+            if(res > 0)
+                set_count(&bench.sent, bench.sent + res);
+            else if(res < 0 && errno != EAGAIN)
+                break;
+            if(res == n && bench.test == TEST_FLOOD)
+                continue;
+        }
+        /* wait for room in the pty (flood) or for the next bytes to be due */
+        {
+            struct pollfd pfd;
+            pfd.fd = bench.master;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, 1);
+        }
+    }
+    return 0;
+}
+
+/* read and check what the patch sends */
+static void *device_receive(void *dummy)
+{
+    unsigned char buf[4096];
+    (void)dummy;
+
+    while(!stopped())
+    {
+        struct pollfd pfd;
+        ssize_t res, i;
+        pfd.fd = bench.master;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 10) <= 0)
+            continue;
+        res = read(bench.master, buf, sizeof(buf));
+        if(res <= 0)
+            continue;
+        for(i = 0; i < res; i++)
+        {
+            long n = bench.received;
+            if(n < bench.capacity)
+            {
+                if(buf[i] != (n & 0xff))
+                    bench.misordered++;
+                add_latency(now() - bench.stamps[n]);
+            }
+            set_count(&bench.received, n + 1);
+        }
+        bench.t_last = now();
+    }
+    return 0;
+}
+
+/* one byte at a time, wait for it to come back */
+static void *device_echo(void *dummy)
+{
+    unsigned char c = 0, back;
+    (void)dummy;
+
+    while(!stopped() && bench.sent < bench.capacity && now() < bench.end)
+    {
+        double t0 = now(), t;
+        int got = 0;
+        if(write(bench.master, &c, 1) != 1)
+            break;
+        set_count(&bench.sent, bench.sent + 1);
+        while(!stopped() && (t = now()) - t0 < 1.)
+        {
+            struct pollfd pfd;
+            pfd.fd = bench.master;
+            pfd.events = POLLIN;
+            if(poll(&pfd, 1, 10) > 0 && read(bench.master, &back, 1) == 1)
+            {
+                if(back != c)
+                    bench.misordered++;
+                add_latency(now() - t0);
+                set_count(&bench.received, bench.received + 1);
+                got = 1;
+                break;
+            }
+        }
+        if(!got)
+            continue;
+        bench.t_last = now();
+        c++;
+        /* don't lock to the scheduler's phase */
+        usleep(rand() % 2000);
+    }
+    return 0;
+}
+
+/* ------------------------------ one run ------------------------------ */
+
+static void tx_send_due(double start)
+{
+    t_atom argv[BENCH_MAXLIST];
+    long due = (long)((now() - start) * bench.baud / 10.);
+    if(due > bench.capacity)
+        due = bench.capacity;
+    while(bench.sent < due)
+    {
+        long n = due - bench.sent, i;
+        double t = now();
+        if(n > BENCH_MAXLIST)
+            n = BENCH_MAXLIST;
+        for(i = 0; i < n; i++)
+        {
+            SETFLOAT(argv + i, (bench.sent + i) & 0xff);
+            bench.stamps[bench.sent + i] = t;
+        }
+        set_count(&bench.sent, bench.sent + n);
+        pdstub_send(bench.comport, "list", n, argv);
+    }
+}
+
+static int run(FILE *csv, const char *label)
+{
+    t_atom a;
+    double start, cpu, wall, limit;
+    void *(*device)(void *);
+    long expected;
+
+    memset(&bench.comport, 0, sizeof(bench) - offsetof(t_bench, comport));
+    bench.master = -1;
+    if(!pty_open())
+        return 0;
+
+    /* what we might need to keep track of, with some headroom; the flood
+       test only counts */
+    if(bench.test == TEST_FLOOD)
+        expected = LONG_MAX;
+    else if(bench.test == TEST_ECHO)
+        expected = (long)(bench.duration * 10000.) + 16;
+    else
+        expected = (long)(bench.duration * bench.baud / 10.) + 16;
+    bench.capacity = expected;
+    if(bench.test != TEST_FLOOD)
+        bench.latency = calloc(expected, sizeof(double));
+    if(bench.test == TEST_RX || bench.test == TEST_TX)
+        bench.stamps = calloc(expected, sizeof(double));
+
+    SETFLOAT(&a, -1);
+    bench.comport = pdstub_newobject("comport", 1, &a);
+    pdstub_sendv(bench.comport, "iomode", "s", bench.iomode);
+    pdstub_sendv(bench.comport, "pollintervall", "f", (double)bench.pollintervall);
+    pdstub_sendv(bench.comport, "baud", "f", (double)bench.baud);
+    if(verbose)
+        pdstub_sendv(bench.comport, "verbose", "f", 1.);
+    pdstub_sendv(bench.comport, "devicename", "s", bench.slave);
+    for(limit = now() + 2.; !bench.open && now() < limit; )
+        pdstub_run(BENCH_TICK, BENCH_TICK, 1);
+    if(!bench.open)
+    {
+        fprintf(stderr, "comport-bench: could not open %s\n", bench.slave);
+        pdstub_free(bench.comport);
+        close(bench.master);
+        return 0;
+    }
+    pdstub_sendv(bench.comport, "stats", "s", "reset");
+
+    device = (bench.test == TEST_TX) ? device_receive
+        : (bench.test == TEST_ECHO) ? device_echo : device_send;
+
+    cpu = thread_cputime();
+    start = now();
+    bench.end = start + bench.duration;
+    bench.t_first = bench.t_last = start;
+    pthread_create(&bench.thread, 0, device, 0);
+
+    while(now() < bench.end)
+    {
+        if(bench.test == TEST_TX)
+            tx_send_due(start);
+        pdstub_run(BENCH_TICK, BENCH_TICK, bench.test != TEST_FLOOD);
+    }
+    /* let whatever is in flight arrive */
+    for(limit = now() + BENCH_DRAIN; now() < limit; )
+    {
+        pdstub_run(BENCH_TICK, BENCH_TICK, 1);
+        if(count(&bench.received) >= count(&bench.sent))
+            break;
+    }
+    __atomic_store_n(&bench.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(bench.thread, 0);
+    cpu = thread_cputime() - cpu;
+
+    pdstub_sendv(bench.comport, "stats", "");
+    pdstub_free(bench.comport);
+    close(bench.master);
+
+    wall = bench.t_last - bench.t_first;
+    qsort(bench.latency, bench.nlatency, sizeof(double), compare_doubles);
+    fprintf(csv, "%s,%s,%s,%d,%d,%.3f,%ld,%.0f,%.1f,%.0f,%.0f,%.0f,%.0f,%.0f,%ld\n",
+        label, test_names[bench.test], bench.iomode, bench.test == TEST_FLOOD ? 0 : bench.baud,
+        bench.pollintervall, wall, bench.received,
+        (wall > 0) ? bench.received / wall : 0.,
+        bench.received ? cpu * 1e9 / bench.received : 0.,
+        percentile(bench.latency, bench.nlatency, 0.5),
+        percentile(bench.latency, bench.nlatency, 0.9),
+        percentile(bench.latency, bench.nlatency, 0.99),
+        bench.nlatency ? bench.latency[bench.nlatency - 1] : -1,
+        bench.txdropped,
+        bench.sent - bench.received + bench.misordered);
+    fflush(csv);
+    free(bench.stamps);
+    free(bench.latency);
+    return 1;
+}
+
+/* -------------------------------- main ------------------------------- */
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: comport-bench [-d seconds] [-m iomodes] [-b bauds] [-p intervals]\n"
+        "                     [-t tests] [-l label] [-o file.csv] [-v]\n"
+        "  defaults: -d 1 -m poll,thread,event,shared -b 9600,115200,921600\n"
+        "            -p 1,10 -t rx,tx,echo,flood\n");
+}
+
+int main(int argc, char **argv)
+{
+    char modes[256] = "poll,thread,event,shared", bauds[256] = "9600,115200,921600",
+        intervals[256] = "1,10", tests[256] = "rx,tx,echo,flood";
+    const char *mode[8], *baud[16], *interval[16], *test[TEST_COUNT];
+    int nmodes, nbauds, nintervals, ntests, t, m, b, p, opt, failed = 0;
+    const char *label = "", *outfile = 0;
+    double duration = 1.;
+    FILE *csv = stdout;
+
+    while((opt = getopt(argc, argv, "d:m:b:p:t:l:o:vh")) != -1)
+    {
+        switch(opt)
+        {
+        case 'd': duration = atof(optarg); break;
+        case 'm': snprintf(modes, sizeof(modes), "%s", optarg); break;
+        case 'b': snprintf(bauds, sizeof(bauds), "%s", optarg); break;
+        case 'p': snprintf(intervals, sizeof(intervals), "%s", optarg); break;
+        case 't': snprintf(tests, sizeof(tests), "%s", optarg); break;
+        case 'l': label = optarg; break;
+        case 'o': outfile = optarg; break;
+        case 'v': verbose = 1; break;
+        default: usage(); return 2;
+        }
+    }
+    if(duration <= 0)
+    {
+        usage();
+        return 2;
+    }
+    nmodes = split(modes, mode, 8);
+    nbauds = split(bauds, baud, 16);
+    nintervals = split(intervals, interval, 16);
+    ntests = split(tests, test, TEST_COUNT);
+
+    if(outfile && !(csv = fopen(outfile, "w")))
+    {
+        perror(outfile);
+        return 1;
+    }
+    pdstub_setquiet(!verbose);
+    pdstub_setoutlethook(outlet_hook, 0);
+    comport_setup();
+
+    fprintf(csv, "label,test,iomode,baud,pollintervall,seconds,bytes,bytes_per_sec,"
+        "cpu_ns_per_byte,lat_p50_us,lat_p90_us,lat_p99_us,lat_max_us,txdropped,dropped\n");
+    for(t = 0; t < ntests; t++)
+    {
+        int id;
+        for(id = 0; id < TEST_COUNT; id++)
+            if(!strcmp(test[t], test_names[id]))
+                break;
+        if(id == TEST_COUNT)
+        {
+            fprintf(stderr, "comport-bench: unknown test '%s'\n", test[t]);
+            failed = 1;
+            continue;
+        }
+        for(m = 0; m < nmodes; m++)
+            for(p = 0; p < nintervals; p++)
+                /* the flood test doesn't pace, so the baud rate is moot */
+                for(b = 0; b < (id == TEST_FLOOD ? 1 : nbauds); b++)
+                {
+                    bench.test = id;
+                    bench.iomode = mode[m];
+                    bench.baud = atoi(baud[b]);
+                    bench.pollintervall = atoi(interval[p]);
+                    bench.duration = duration;
+                    if(!run(csv, label))
+                        failed = 1;
+                }
+    }
+    if(csv != stdout)
+        fclose(csv);
+    return failed;
+}
@@ -0,0 +1,138 @@
+/* m_pd.h - minimal stand-in for Pd's API, just enough to run comport.c
+   outside of Pd (see pdstub.c).  This is NOT the real m_pd.h. */
+
+#ifndef __m_pd_h_
+#define __m_pd_h_
+
+#include <stddef.h>
+
+#define PD_MAJOR_VERSION 0
+#define PD_MINOR_VERSION 54
+#define PD_BUGFIX_VERSION 0
+
+#define EXTERN extern
+#define MAXPDSTRING 1000
+#define MAXPDARG 5
+
+typedef float t_float;
+typedef float t_floatarg;
+typedef float t_sample;
+
+typedef struct _symbol
+{
+    const char *s_name;
+    void *s_thing;
+    struct _symbol *s_next;
+} t_symbol;
+
+typedef struct _class t_class;
+typedef t_class *t_pd;
+
+typedef struct _outlet t_outlet;
+typedef struct _clock t_clock;
+typedef struct _garray t_garray;
+
+typedef struct _object
+{
+    t_pd te_pd;
+    t_outlet *te_outlet;
+} t_object;
+typedef t_object t_text;
+
+typedef enum
+{
+    A_NULL,
+    A_FLOAT,
+    A_SYMBOL,
+    A_POINTER,
+    A_SEMI,
+    A_COMMA,
+    A_DEFFLOAT,
+    A_DEFSYM,
+    A_DOLLAR,
+    A_DOLLSYM,
+    A_GIMME,
+    A_CANT
+} t_atomtype;
+
+typedef union word
+{
+    t_float w_float;
+    t_symbol *w_symbol;
+    int w_index;
+} t_word;
+
+typedef struct _atom
+{
+    t_atomtype a_type;
+    union word a_w;
+} t_atom;
+
+typedef void (*t_method)(void);
+typedef void *(*t_newmethod)(void);
+typedef void (*t_fdpollfn)(void *ptr, int fd);
+
+#define SETFLOAT(atom, f) ((atom)->a_type = A_FLOAT, (atom)->a_w.w_float = (f))
+#define SETSYMBOL(atom, s) ((atom)->a_type = A_SYMBOL, (atom)->a_w.w_symbol = (s))
+
+#define PD_CRITICAL 0
+#define PD_ERROR 1
+#define PD_NORMAL 2
+#define PD_DEBUG 3
+#define PD_VERBOSE 4
+
+EXTERN t_symbol s_, s_float, s_symbol, s_list, s_bang, s_anything;
+
+EXTERN t_symbol *gensym(const char *s);
+EXTERN void *getbytes(size_t nbytes);
+EXTERN void *resizebytes(void *x, size_t oldsize, size_t newsize);
+EXTERN void freebytes(void *x, size_t nbytes);
+
+EXTERN void post(const char *fmt, ...);
+EXTERN void pd_error(const void *object, const char *fmt, ...);
+EXTERN void logpost(const void *object, const int level, const char *fmt, ...);
+
+EXTERN t_float atom_getfloat(const t_atom *a);
+EXTERN int atom_getint(const t_atom *a);
+EXTERN t_symbol *atom_getsymbol(const t_atom *a);
+EXTERN int atom_getintarg(int which, int argc, const t_atom *argv);
+EXTERN t_float atom_getfloatarg(int which, int argc, const t_atom *argv);
+EXTERN t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv);
+EXTERN void atom_string(const t_atom *a, char *buf, unsigned int bufsize);
+
+EXTERN t_class *class_new(t_symbol *name, t_newmethod newmethod,
+    t_method freemethod, size_t size, int flags, t_atomtype arg1, ...);
+EXTERN void class_addmethod(t_class *c, t_method fn, t_symbol *sel,
+    t_atomtype arg1, ...);
+EXTERN void class_addbang(t_class *c, t_method fn);
+EXTERN void class_addfloat(t_class *c, t_method fn);
+EXTERN void class_addlist(t_class *c, t_method fn);
+EXTERN t_pd *pd_new(t_class *cls);
+EXTERN t_pd *pd_findbyclass(t_symbol *s, const t_class *c);
+
+EXTERN t_outlet *outlet_new(t_object *owner, t_symbol *s);
+EXTERN void outlet_bang(t_outlet *x);
+EXTERN void outlet_float(t_outlet *x, t_float f);
+EXTERN void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+EXTERN void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+
+EXTERN t_clock *clock_new(void *owner, t_method fn);
+EXTERN void clock_set(t_clock *x, double systime);
+EXTERN void clock_delay(t_clock *x, double delaytime);
+EXTERN void clock_unset(t_clock *x);
+EXTERN void clock_free(t_clock *x);
+EXTERN double clock_getlogicaltime(void);
+EXTERN double clock_gettimesince(double prevsystime);
+EXTERN double sys_getrealtime(void);
+
+EXTERN void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr);
+EXTERN void sys_rmpollfn(int fd);
+EXTERN void sys_lock(void);
+EXTERN void sys_unlock(void);
+
+EXTERN t_class *garray_class;
+EXTERN int garray_getfloatwords(t_garray *x, int *size, t_word **vec);
+EXTERN void garray_redraw(t_garray *x);
+EXTERN void garray_usedindsp(t_garray *x);
+
+#endif /* __m_pd_h_ */
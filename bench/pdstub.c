@@ -0,0 +1,678 @@
+/* pdstub - a minimal, single-threaded stand-in for the parts of Pd's API that
+   comport.c uses, so the external can be driven headless by a benchmark.
+
+   - messages are dispatched by selector to the methods registered with
+     class_addmethod() (only the argument signatures comport uses)
+   - outlets call a user supplied hook instead of connections
+   - clocks run on a logical timeline advanced by pdstub_run(), which also
+     services the fds registered with sys_addpollfn() and (optionally) paces
+     logical time against the monotonic clock like Pd's scheduler does
+*/
+
+#define _GNU_SOURCE
+#include "m_pd.h"
+#include "pdstub.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+
+#define STUB_MAXMETHODS 128
+#define STUB_MAXCLOCKS 1024
+#define STUB_MAXPOLLFNS 256
+#define STUB_MAXOUTLETS 8
+#define STUB_MAXSYMBOLS 4096
+#define STUB_MAXARRAYS 16
+#define STUB_TIMEUNIT 1000. /* logical time is kept in usec */
+
+t_symbol s_ = {"", 0, 0};
+t_symbol s_float = {"float", 0, 0};
+t_symbol s_symbol = {"symbol", 0, 0};
+t_symbol s_list = {"list", 0, 0};
+t_symbol s_bang = {"bang", 0, 0};
+t_symbol s_anything = {"anything", 0, 0};
+
+typedef struct _stubmethod
+{
+    t_symbol *m_sel;
+    t_method m_fn;
+    t_atomtype m_args[MAXPDARG + 1];
+} t_stubmethod;
+
+struct _class
+{
+    t_symbol *c_name;
+    t_newmethod c_new;
+    t_method c_free;
+    size_t c_size;
+    t_method c_float;
+    t_method c_list;
+    t_method c_bang;
+    int c_nmethods;
+    t_stubmethod c_methods[STUB_MAXMETHODS];
+};
+
+struct _outlet
+{
+    t_object *o_owner;
+    int o_index;
+    t_outlet *o_next;
+};
+
+struct _clock
+{
+    void *c_owner;
+    t_method c_fn;
+    double c_settime; /* < 0 if unset */
+};
+
+struct _garray
+{
+    t_pd g_pd;
+    t_symbol *g_name;
+    t_word *g_vec;
+    int g_n;
+    int g_redraws;
+};
+
+static t_class *stub_classes[8];
+static int stub_nclasses;
+static t_symbol *stub_symbols[STUB_MAXSYMBOLS];
+static int stub_nsymbols;
+static t_clock *stub_clocks[STUB_MAXCLOCKS];
+static int stub_nclocks;
+static struct { int fd; t_fdpollfn fn; void *ptr; } stub_pollfns[STUB_MAXPOLLFNS];
+static int stub_npollfns;
+static double stub_logicaltime; /* in STUB_TIMEUNITs */
+static double stub_realtime0 = -1;
+static t_pdstub_outletfn stub_outlethook;
+static void *stub_outlethook_user;
+static int stub_quiet;
+static t_garray stub_arrays[STUB_MAXARRAYS];
+static int stub_narrays;
+static t_class stub_garray_class;
+t_class *garray_class = &stub_garray_class;
+
+/* ----------------------- memory & symbols ------------------------ */
+
+void *getbytes(size_t nbytes)
+{
+    return calloc(1, nbytes ? nbytes : 1);
+}
+
+void *resizebytes(void *x, size_t oldsize, size_t newsize)
+{
+    void *y = realloc(x, newsize ? newsize : 1);
+    if (y && newsize > oldsize)
+        memset((char *)y + oldsize, 0, newsize - oldsize);
+    return y;
+}
+
+void freebytes(void *x, size_t nbytes)
+{
+    (void)nbytes;
+    free(x);
+}
+
+t_symbol *gensym(const char *s)
+{
+    int i;
+    t_symbol *sym;
+    for (i = 0; i < stub_nsymbols; i++)
+        if (!strcmp(stub_symbols[i]->s_name, s))
+            return stub_symbols[i];
+    if (!*s) return &s_;
+    if (!strcmp(s, "float")) return &s_float;
+    if (!strcmp(s, "list")) return &s_list;
+    if (!strcmp(s, "symbol")) return &s_symbol;
+    if (!strcmp(s, "bang")) return &s_bang;
+    if (stub_nsymbols >= STUB_MAXSYMBOLS)
+    {
+        fprintf(stderr, "pdstub: symbol table full\n");
+        abort();
+    }
+    sym = calloc(1, sizeof(*sym));
+    sym->s_name = strdup(s);
+    stub_symbols[stub_nsymbols++] = sym;
+    return sym;
+}
+
+/* ----------------------------- printing -------------------------- */
+
+void pdstub_setquiet(int quiet)
+{
+    stub_quiet = quiet;
+}
+
+static void stub_vpost(const char *prefix, const char *fmt, va_list ap)
+{
+    if (stub_quiet)
+        return;
+    fputs(prefix, stderr);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+}
+
+void post(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    stub_vpost("", fmt, ap);
+    va_end(ap);
+}
+
+void pd_error(const void *object, const char *fmt, ...)
+{
+    va_list ap;
+    (void)object;
+    va_start(ap, fmt);
+    stub_vpost("error: ", fmt, ap);
+    va_end(ap);
+}
+
+void logpost(const void *object, const int level, const char *fmt, ...)
+{
+    va_list ap;
+    (void)object;
+    if (level > PD_NORMAL)
+        return;
+    va_start(ap, fmt);
+    stub_vpost("", fmt, ap);
+    va_end(ap);
+}
+
+/* ------------------------------- atoms --------------------------- */
+
+t_float atom_getfloat(const t_atom *a)
+{
+    return (a->a_type == A_FLOAT) ? a->a_w.w_float : 0;
+}
+
+int atom_getint(const t_atom *a)
+{
+    return (int)atom_getfloat(a);
+}
+
+t_symbol *atom_getsymbol(const t_atom *a)
+{
+    return (a->a_type == A_SYMBOL) ? a->a_w.w_symbol : &s_symbol;
+}
+
+t_float atom_getfloatarg(int which, int argc, const t_atom *argv)
+{
+    return (which < argc) ? atom_getfloat(argv + which) : 0;
+}
+
+int atom_getintarg(int which, int argc, const t_atom *argv)
+{
+    return (int)atom_getfloatarg(which, argc, argv);
+}
+
+t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv)
+{
+    return (which < argc) ? atom_getsymbol(argv + which) : &s_;
+}
+
+void atom_string(const t_atom *a, char *buf, unsigned int bufsize)
+{
+    if (a->a_type == A_FLOAT)
+        snprintf(buf, bufsize, "%g", a->a_w.w_float);
+    else if (a->a_type == A_SYMBOL)
+        snprintf(buf, bufsize, "%s", a->a_w.w_symbol->s_name);
+    else if (bufsize)
+        *buf = 0;
+}
+
+/* ------------------------------ classes -------------------------- */
+
+t_class *class_new(t_symbol *name, t_newmethod newmethod,
+    t_method freemethod, size_t size, int flags, t_atomtype arg1, ...)
+{
+    t_class *c = calloc(1, sizeof(*c));
+    (void)flags; (void)arg1;
+    c->c_name = name;
+    c->c_new = newmethod;
+    c->c_free = freemethod;
+    c->c_size = size;
+    if (stub_nclasses < (int)(sizeof(stub_classes)/sizeof(*stub_classes)))
+        stub_classes[stub_nclasses++] = c;
+    return c;
+}
+
+void class_addmethod(t_class *c, t_method fn, t_symbol *sel,
+    t_atomtype arg1, ...)
+{
+    va_list ap;
+    t_atomtype t = arg1;
+    int n = 0;
+    t_stubmethod *m;
+    if (c->c_nmethods >= STUB_MAXMETHODS)
+    {
+        fprintf(stderr, "pdstub: too many methods\n");
+        abort();
+    }
+    m = &c->c_methods[c->c_nmethods++];
+    m->m_sel = sel;
+    m->m_fn = fn;
+    va_start(ap, arg1);
+    while (t != A_NULL && n < MAXPDARG)
+    {
+        m->m_args[n++] = t;
+        t = (t_atomtype)va_arg(ap, int);
+    }
+    m->m_args[n] = A_NULL;
+    va_end(ap);
+}
+
+void class_addbang(t_class *c, t_method fn) { c->c_bang = fn; }
+void class_addfloat(t_class *c, t_method fn) { c->c_float = fn; }
+void class_addlist(t_class *c, t_method fn) { c->c_list = fn; }
+
+t_pd *pd_new(t_class *cls)
+{
+    t_pd *x = getbytes(cls->c_size);
+    *x = cls;
+    return x;
+}
+
+t_pd *pd_findbyclass(t_symbol *s, const t_class *c)
+{
+    int i;
+    if (c != garray_class)
+        return 0;
+    for (i = 0; i < stub_narrays; i++)
+        if (stub_arrays[i].g_name == s)
+            return &stub_arrays[i].g_pd;
+    return 0;
+}
+
+t_pd *pdstub_newobject(const char *classname, int argc, t_atom *argv)
+{
+    int i;
+    for (i = 0; i < stub_nclasses; i++)
+        if (!strcmp(stub_classes[i]->c_name->s_name, classname))
+            return (t_pd *)((void *(*)(t_symbol *, int, t_atom *))
+                stub_classes[i]->c_new)(gensym(classname), argc, argv);
+    return 0;
+}
+
+void pdstub_free(t_pd *x)
+{
+    t_class *c = *x;
+    t_outlet *o, *next;
+    if (c->c_free)
+        ((void (*)(void *))c->c_free)(x);
+    for (o = ((t_object *)x)->te_outlet; o; o = next)
+    {
+        next = o->o_next;
+        free(o);
+    }
+    free(x);
+}
+
+typedef void (*t_fn0)(void *);
+typedef void (*t_fnf)(void *, t_floatarg);
+typedef void (*t_fnff)(void *, t_floatarg, t_floatarg);
+typedef void (*t_fns)(void *, t_symbol *);
+typedef void (*t_fnsf)(void *, t_symbol *, t_floatarg);
+typedef void (*t_fnsff)(void *, t_symbol *, t_floatarg, t_floatarg);
+typedef void (*t_fngimme)(void *, t_symbol *, int, t_atom *);
+
+int pdstub_send(t_pd *x, const char *selector, int argc, t_atom *argv)
+{
+    t_class *c = *x;
+    t_symbol *sel = gensym(selector);
+    t_floatarg f[MAXPDARG];
+    t_symbol *sym = &s_symbol;
+    int i, nf = 0;
+
+    if (sel == &s_float && c->c_float)
+    {
+        ((t_fnf)c->c_float)(x, atom_getfloatarg(0, argc, argv));
+        return 1;
+    }
+    if (sel == &s_list && c->c_list)
+    {
+        ((t_fngimme)c->c_list)(x, sel, argc, argv);
+        return 1;
+    }
+    if (sel == &s_bang && c->c_bang)
+    {
+        ((t_fn0)c->c_bang)(x);
+        return 1;
+    }
+    for (i = 0; i < c->c_nmethods; i++)
+    {
+        t_stubmethod *m = &c->c_methods[i];
+        int j, nsym = 0;
+        if (m->m_sel != sel)
+            continue;
+        if (m->m_args[0] == A_GIMME)
+        {
+            ((t_fngimme)m->m_fn)(x, sel, argc, argv);
+            return 1;
+        }
+        for (j = 0; m->m_args[j] != A_NULL; j++)
+        {
+            switch (m->m_args[j])
+            {
+            case A_FLOAT:
+            case A_DEFFLOAT:
+                f[nf++] = atom_getfloatarg(j, argc, argv);
+                break;
+            case A_SYMBOL:
+            case A_DEFSYM:
+                sym = atom_getsymbolarg(j, argc, argv);
+                nsym++;
+                break;
+            default:
+                break;
+            }
+        }
+        if (nsym == 0 && nf == 0) ((t_fn0)m->m_fn)(x);
+        else if (nsym == 0 && nf == 1) ((t_fnf)m->m_fn)(x, f[0]);
+        else if (nsym == 0 && nf == 2) ((t_fnff)m->m_fn)(x, f[0], f[1]);
+        else if (nsym == 1 && nf == 0) ((t_fns)m->m_fn)(x, sym);
+        else if (nsym == 1 && nf == 1) ((t_fnsf)m->m_fn)(x, sym, f[0]);
+        else if (nsym == 1 && nf == 2) ((t_fnsff)m->m_fn)(x, sym, f[0], f[1]);
+        else
+        {
+            fprintf(stderr, "pdstub: unsupported signature for '%s'\n", selector);
+            return 0;
+        }
+        return 1;
+    }
+    fprintf(stderr, "pdstub: no method for '%s'\n", selector);
+    return 0;
+}
+
+int pdstub_sendv(t_pd *x, const char *selector, const char *fmt, ...)
+{
+    t_atom argv[64];
+    int argc = 0;
+    va_list ap;
+    va_start(ap, fmt);
+    for (; *fmt && argc < 64; fmt++, argc++)
+    {
+        if (*fmt == 'f')
+            SETFLOAT(argv + argc, (t_float)va_arg(ap, double));
+        else
+            SETSYMBOL(argv + argc, gensym(va_arg(ap, const char *)));
+    }
+    va_end(ap);
+    return pdstub_send(x, selector, argc, argv);
+}
+
+/* ------------------------------ outlets -------------------------- */
+
+void pdstub_setoutlethook(t_pdstub_outletfn fn, void *user)
+{
+    stub_outlethook = fn;
+    stub_outlethook_user = user;
+}
+
+t_outlet *outlet_new(t_object *owner, t_symbol *s)
+{
+    t_outlet *o = calloc(1, sizeof(*o)), **op;
+    int n = 0;
+    (void)s;
+    o->o_owner = owner;
+    for (op = &owner->te_outlet; *op; op = &(*op)->o_next)
+        n++;
+    o->o_index = n;
+    *op = o;
+    return o;
+}
+
+static void stub_outlet(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (stub_outlethook)
+        stub_outlethook(stub_outlethook_user, x->o_owner, x->o_index,
+            s, argc, argv);
+}
+
+void outlet_bang(t_outlet *x)
+{
+    stub_outlet(x, &s_bang, 0, 0);
+}
+
+void outlet_float(t_outlet *x, t_float f)
+{
+    t_atom a;
+    SETFLOAT(&a, f);
+    stub_outlet(x, &s_float, 1, &a);
+}
+
+void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+    (void)s;
+    stub_outlet(x, &s_list, argc, argv);
+}
+
+void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+    stub_outlet(x, s, argc, argv);
+}
+
+/* --------------------------- time & clocks ----------------------- */
+
+static double stub_monotonic(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+double sys_getrealtime(void)
+{
+    if (stub_realtime0 < 0)
+        stub_realtime0 = stub_monotonic();
+    return stub_monotonic() - stub_realtime0;
+}
+
+double clock_getlogicaltime(void)
+{
+    return stub_logicaltime;
+}
+
+double clock_gettimesince(double prevsystime)
+{
+    return (stub_logicaltime - prevsystime) / STUB_TIMEUNIT;
+}
+
+t_clock *clock_new(void *owner, t_method fn)
+{
+    t_clock *c = calloc(1, sizeof(*c));
+    int i;
+    c->c_owner = owner;
+    c->c_fn = fn;
+    c->c_settime = -1;
+    for (i = 0; i < stub_nclocks; i++)
+        if (!stub_clocks[i])
+            break;
+    if (i == STUB_MAXCLOCKS)
+    {
+        fprintf(stderr, "pdstub: too many clocks\n");
+        abort();
+    }
+    stub_clocks[i] = c;
+    if (i == stub_nclocks)
+        stub_nclocks++;
+    return c;
+}
+
+void clock_set(t_clock *x, double systime)
+{
+    x->c_settime = (systime < stub_logicaltime) ? stub_logicaltime : systime;
+}
+
+void clock_delay(t_clock *x, double delaytime)
+{
+    clock_set(x, stub_logicaltime + (delaytime > 0 ? delaytime : 0) * STUB_TIMEUNIT);
+}
+
+void clock_unset(t_clock *x)
+{
+    x->c_settime = -1;
+}
+
+void clock_free(t_clock *x)
+{
+    int i;
+    for (i = 0; i < stub_nclocks; i++)
+        if (stub_clocks[i] == x)
+            stub_clocks[i] = 0;
+    free(x);
+}
+
+void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
+{
+    if (stub_npollfns >= STUB_MAXPOLLFNS)
+    {
+        fprintf(stderr, "pdstub: too many pollfns\n");
+        abort();
+    }
+    stub_pollfns[stub_npollfns].fd = fd;
+    stub_pollfns[stub_npollfns].fn = fn;
+    stub_pollfns[stub_npollfns].ptr = ptr;
+    stub_npollfns++;
+}
+
+void sys_rmpollfn(int fd)
+{
+    int i;
+    for (i = 0; i < stub_npollfns; i++)
+        if (stub_pollfns[i].fd == fd)
+        {
+            stub_pollfns[i] = stub_pollfns[--stub_npollfns];
+            return;
+        }
+    fprintf(stderr, "pdstub: sys_rmpollfn: fd %d not found\n", fd);
+}
+
+void sys_lock(void) {}
+void sys_unlock(void) {}
+
+int pdstub_pollfds(int timeout_ms)
+{
+    struct pollfd pfd[STUB_MAXPOLLFNS];
+    int i, n = stub_npollfns, ready, didsomething = 0;
+    for (i = 0; i < n; i++)
+    {
+        pfd[i].fd = stub_pollfns[i].fd;
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
+    }
+    ready = poll(pfd, n, timeout_ms);
+    if (ready <= 0)
+        return 0;
+    for (i = 0; i < n; i++)
+    {
+        int j;
+        if (!pfd[i].revents)
+            continue;
+        /* callbacks may have removed entries: look the fd up again */
+        for (j = 0; j < stub_npollfns; j++)
+            if (stub_pollfns[j].fd == pfd[i].fd)
+            {
+                stub_pollfns[j].fn(stub_pollfns[j].ptr, pfd[i].fd);
+                didsomething = 1;
+                break;
+            }
+    }
+    return didsomething;
+}
+
+static void stub_runclocks(double until)
+{
+    for (;;)
+    {
+        t_clock *next = 0;
+        int i;
+        for (i = 0; i < stub_nclocks; i++)
+        {
+            t_clock *c = stub_clocks[i];
+            if (c && c->c_settime >= 0 && c->c_settime <= until
+                && (!next || c->c_settime < next->c_settime))
+                next = c;
+        }
+        if (!next)
+            break;
+        stub_logicaltime = next->c_settime;
+        next->c_settime = -1;
+        ((t_fn0)next->c_fn)(next->c_owner);
+    }
+    stub_logicaltime = until;
+}
+
+void pdstub_run(double ms, double tick_ms, int realtime)
+{
+    double end = stub_logicaltime + ms * STUB_TIMEUNIT;
+    double start_real = sys_getrealtime();
+    double start_logical = stub_logicaltime;
+    while (stub_logicaltime < end)
+    {
+        double next = stub_logicaltime + tick_ms * STUB_TIMEUNIT;
+        if (next > end)
+            next = end;
+        stub_runclocks(next);
+        if (realtime)
+        {
+            /* like Pd's scheduler: sleep in poll() until the logical time
+               is due in real time */
+            for (;;)
+            {
+                double ahead = (stub_logicaltime - start_logical) / STUB_TIMEUNIT
+                    - (sys_getrealtime() - start_real) * 1000.;
+                if (ahead <= 0)
+                    break;
+                pdstub_pollfds(ahead < 1 ? 1 : (int)ahead);
+            }
+            pdstub_pollfds(0);
+        }
+        else
+            pdstub_pollfds(0);
+    }
+}
+
+/* ------------------------------ arrays --------------------------- */
+
+t_word *pdstub_array_new(const char *name, int n)
+{
+    t_garray *g;
+    if (stub_narrays >= STUB_MAXARRAYS)
+        return 0;
+    g = &stub_arrays[stub_narrays++];
+    g->g_pd = garray_class;
+    g->g_name = gensym(name);
+    g->g_vec = calloc(n ? n : 1, sizeof(t_word));
+    g->g_n = n;
+    return g->g_vec;
+}
+
+int pdstub_array_redraws(const char *name)
+{
+    t_garray *g = (t_garray *)pd_findbyclass(gensym(name), garray_class);
+    return g ? g->g_redraws : -1;
+}
+
+int garray_getfloatwords(t_garray *x, int *size, t_word **vec)
+{
+    *size = x->g_n;
+    *vec = x->g_vec;
+    return 1;
+}
+
+void garray_redraw(t_garray *x)
+{
+    x->g_redraws++;
+}
+
+void garray_usedindsp(t_garray *x)
+{
+    (void)x;
+}
@@ -0,0 +1,35 @@
+/* pdstub.h - driver interface of the headless Pd stand-in (see pdstub.c) */
+
+#ifndef PDSTUB_H
+#define PDSTUB_H
+
+#include "m_pd.h"
+
+typedef void (*t_pdstub_outletfn)(void *user, t_object *owner, int outlet,
+    t_symbol *s, int argc, t_atom *argv);
+
+/* create/free an object of a class registered via its setup function */
+t_pd *pdstub_newobject(const char *classname, int argc, t_atom *argv);
+void pdstub_free(t_pd *x);
+
+/* send a message; pdstub_sendv() takes a type string of 'f' (double)
+   and 's' (const char*) arguments */
+int pdstub_send(t_pd *x, const char *selector, int argc, t_atom *argv);
+int pdstub_sendv(t_pd *x, const char *selector, const char *fmt, ...);
+
+/* all outlets of all objects end up here */
+void pdstub_setoutlethook(t_pdstub_outletfn fn, void *user);
+
+/* advance logical time by 'ms' in steps of 'tick_ms', firing clocks and
+   servicing sys_addpollfn() fds; if 'realtime' is set, logical time is
+   paced against the monotonic clock */
+void pdstub_run(double ms, double tick_ms, int realtime);
+int pdstub_pollfds(int timeout_ms);
+
+/* named arrays for pd_findbyclass(..., garray_class) */
+t_word *pdstub_array_new(const char *name, int n);
+int pdstub_array_redraws(const char *name);
+
+void pdstub_setquiet(int quiet);
+
+#endif /* PDSTUB_H */
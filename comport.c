@@ -28,7 +28,12 @@ JZ 20210321 allow the user to turn ON input processing (again)
 JZ 20210321 allow the user to specify a device pattern as creation argument
 */
 
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* for posix_openpt() and friends */
+#endif
+
 #include "m_pd.h"
+#include "libcomport.h"
 
 #ifdef _MSC_VER
 #pragma warning( disable : 4244 )
@@ -45,6 +50,12 @@ JZ 20210321 allow the user to specify a device pattern as creation argument
 #include <termios.h> /* for TERMIO ioctl calls */
 #include <unistd.h>
 #include <glob.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #define HANDLE int
 #define INVALID_HANDLE_VALUE -1
 #endif /* _WIN32 */
@@ -58,6 +69,22 @@ JZ 20210321 allow the user to specify a device pattern as creation argument
 
 #define t_bool char
 
+/* how incoming data is fetched from the device */
+#define COMPORT_IOMODE_POLL 0 /* select()/read() in the clock callback */
+#define COMPORT_IOMODE_THREAD 1 /* a reader thread fills x_rxring, the clock drains it */
+#define COMPORT_IOMODE_EVENT 2 /* Pd's fd polling calls us when the device is readable */
+#define COMPORT_IOMODE_SHARED 3 /* one engine thread reads all ports, see libcomport.h */
+
+/* when the TX queue is written */
+#define COMPORT_TXMODE_TICK 0 /* by the clock callback */
+#define COMPORT_TXMODE_IMMEDIATE 1 /* at the end of each message */
+#define COMPORT_TXMODE_THREAD 2 /* by a writer thread as soon as data is queued */
+
+/* backoff of the reconnector (ms) */
+#define COMPORT_RECONNECT_DELAY 50 /* first retry, doubled with every failure... */
+#define COMPORT_RECONNECT_MAXDELAY 2000 /* ...up to this by default */
+#define COMPORT_PTY "pty" /* devicename for a pseudo-terminal (not on Windows) */
+
 typedef struct comport
 {
   /* basic object properties */
@@ -73,7 +100,7 @@ typedef struct comport
 #else
     int             comhandle; /* holds the comport handle */
     struct termios  oldcom_termio; /* save the old com config */
-    struct termios  com_termio; /* for the new com config */
+    t_comconfig     x_config; /* for the new com config */
 #endif
 
   /* device specifications */
@@ -81,6 +108,7 @@ typedef struct comport
     const char*     pretty_name;
     char            serial_device_prefix[MAXPDSTRING];/* the device name without the number */
     short           comport; /* holds the comport # */
+    struct comport  *x_next_instance; /* see comdevices_addinstance() */
 
   /* device configuration */
     int             baud; /* holds the current baud rate */
@@ -90,6 +118,10 @@ typedef struct comport
     t_bool          xonxoff; /* nonzero if xonxoff handshaking is on */
     t_bool          ctsrts; /* nonzero if ctsrts handshaking is on */
     t_bool          hupcl; /* nonzero if hang-up on close is on */
+    t_bool          x_lowlatency; /* nonzero if the driver should not batch input */
+    int             x_latency_timer; /* usb-serial latency timer (ms) to use with it */
+    int             x_lowlatency_saved; /* the driver's settings before we touched them, */
+    int             x_latency_timer_saved; /* -1 if we didn't */
 
     int             rxerrors; /* holds the rx line errors */
 
@@ -98,10 +130,86 @@ typedef struct comport
 
   /* buffers */
     unsigned char   *x_inbuf; /* read incoming serial to here */
-    unsigned char   *x_outbuf; /* write outgoing serial from here */
     int             x_inbuf_len; /* length of inbuf */
-    int             x_outbuf_len; /* length of outbuf */
-    int             x_outbuf_wr_index; /* offset to next free location in x_outbuf */
+    int             x_rxbufsize; /* sizes of the buffers, */
+    int             x_txbufsize; /* which only exist while open */
+    t_comring       x_txring; /* outgoing bytes, kept until the device takes them */
+    size_t          x_txstaged; /* bytes put behind the queue but not committed yet */
+    unsigned char   *x_txscratch; /* if set, stage into this instead (sendat) */
+    size_t          x_txscratch_size;
+    int             x_txhigh; /* report backpressure when the queue fills up to here... */
+    int             x_txlow; /* ...until it has drained down to here */
+    t_bool          x_txbackpressure;
+    int             txerrors; /* failed writes */
+    int             x_txmode; /* COMPORT_TXMODE_... */
+    int             x_txwindow; /* usec to wait for more data before writing */
+    t_clock         *x_txclock; /* ends the window in immediate mode */
+    t_comsched      x_sendat; /* payloads of sendat by when they are due (comclock_now()) */
+    t_clock         *x_sendat_clock; /* sends them when there is no writer thread */
+
+  /* output */
+    t_bool          x_blockmode; /* nonzero if received chunks go out as one list */
+    int             x_blocksize; /* max. length of such a list, 0 for as much as was read */
+    t_atom          *x_atombuf; /* reused for the lists */
+    int             x_atombuf_len; /* length of atombuf */
+    int             x_outputting; /* a list from atombuf is on its way out */
+    t_bool          x_atombuf_stale; /* ...and it is to be resized when done */
+    t_comframer     x_framer;
+    t_comfield      *x_unpack; /* the record format of received frames, NULL if off */
+    int             x_unpack_nfields;
+    int             x_unpack_size; /* bytes per record */
+    int             x_unpack_nvalues; /* values per record */
+    unsigned long   x_unpack_errors; /* frames that didn't hold whole records */
+    t_symbol        *x_rxarray; /* recordarray: received samples go here, NULL if off */
+    t_comfield      x_rxarray_field; /* ...in this format */
+    int             x_rxarray_pos; /* the write index */
+    unsigned char   x_rxarray_partial[8]; /* the bytes of a sample received so far... */
+    int             x_rxarray_fill; /* ...and how many */
+    double          x_rxarray_redraw; /* min. ms between redraws */
+    double          x_rxarray_drawn; /* logical time of the last one */
+    t_bool          x_rxarray_dirty; /* a redraw is scheduled */
+    t_clock         *x_rxarray_clock;
+
+  /* encoding of outgoing frames */
+    int             x_encoder; /* COMPORT_FRAME_NONE, _SLIP, _COBS or _HDLC */
+    size_t          x_txframe_code; /* COBS: staged offset of the pending code byte */
+    t_bool          x_txframe_overflow; /* the current frame didn't fit */
+
+  /* checksums of frames */
+    const t_comcheck *x_check; /* verified on received frames, appended to sent ones; NULL if off */
+    int             x_check_skip; /* leading bytes of a frame that aren't covered */
+    unsigned long   x_check_errors; /* received frames with a bad checksum */
+    unsigned long   x_txcheck; /* running checksum of the message being sent... */
+    int             x_txcheck_len; /* ...and the number of bytes in it */
+
+  /* writearray, streamed into the queue as it drains */
+    t_symbol        *x_txarray; /* the array... */
+    t_comfield      x_txarray_field; /* ...the format of its samples */
+    int             x_txarray_pos; /* the next sample to queue */
+    int             x_txarray_n; /* samples still to queue, 0 if there's no writearray going on */
+    int             x_txarray_total;
+
+  /* timestamps, see comport_output_timestamp() */
+    t_bool          x_timestamp; /* output one before each chunk or frame */
+    double          x_rxstamp; /* comclock_now() of the read that brought what is being output */
+    t_comstamps     x_rxstamps; /* ...noted by the reader thread or the I/O engine */
+    double          x_ts_offset; /* comclock_now() minus logical time, as estimated */
+    double          x_ts_error; /* how far off that might be */
+    double          x_ts_synced; /* comclock_now() of the last estimate, 0 for none */
+
+  /* performance counters, see comport_stats() */
+    t_comstats      x_stats; /* counted by the Pd thread */
+    t_comstats      x_rstats; /* ...by the reader thread */
+    t_comstats      x_wstats; /* ...by the writer thread */
+    int             x_stats_epoch; /* bumped to make the threads clear their counters */
+    unsigned long   x_dataticks; /* clock ticks that moved data */
+    unsigned long   x_emptyticks; /* ...and those that didn't */
+    t_bool          x_tick_hasdata;
+    unsigned long   x_txdropped; /* bytes that didn't fit into the TX queue */
+    size_t          x_rxring_max; /* high-water marks */
+    size_t          x_txqueue_max;
+    double          x_ticktime; /* ms spent in comport_tick() */
+    double          x_tickmax;
 
   /* self-polling */
     t_clock         *x_clock;
@@ -109,6 +217,39 @@ typedef struct comport
     int             x_hit;
     int             x_retries;
     int             x_retry_count;
+
+  /* threaded I/O */
+    int             x_iomode; /* COMPORT_IOMODE_... */
+    t_comring       x_rxring; /* filled by the reader thread or the I/O engine */
+#ifndef _WIN32
+    pthread_t       x_thread;
+    t_bool          x_thread_running;
+    int             x_thread_quit; /* set by the Pd thread to stop the reader */
+    int             x_thread_status; /* set by the reader: 0 (ok), -1 (lost connection) or errno */
+    int             x_wakeup[2]; /* pipe to wake the reader thread */
+    t_bool          x_pollfn_registered; /* nonzero if comhandle is in Pd's fd polling */
+    t_comsource     x_source; /* how the shared I/O engine knows us... */
+    t_bool          x_shared; /* ...while this is nonzero */
+    pthread_t       x_writer;
+    t_bool          x_writer_running;
+    int             x_writer_quit; /* set by the Pd thread to stop the writer */
+    int             x_writer_errors; /* failed writes, counted by the writer */
+    int             x_writer_errors_seen; /* ...and how many of them the Pd thread reported */
+    int             x_txwakeup[2]; /* pipe to wake up the writer */
+    pthread_mutex_t x_sendat_lock; /* guards x_sendat */
+    t_bool          x_reconnect; /* wait for a lost device to come back */
+    t_symbol        *x_reconnect_id; /* how to recognize it, NULL to remember the open one */
+    t_symbol        *x_identity; /* what the reconnector looks for */
+    int             x_reconnect_maxdelay; /* ms, the backoff doesn't grow beyond this */
+    t_bool          x_reconnecting; /* the worker is waiting for the lost device */
+    int             x_reconnect_attempts_seen;
+    struct comworker *x_worker; /* opens, configures and closes the device */
+    int             x_jobs; /* jobs submitted to the worker that are not done yet */
+    t_bool          x_opening; /* one of them will open the device */
+    int             x_generation; /* bumped when closing, to tell stale results */
+    int             x_ptyslave; /* 'devicename pty': the slave side, kept open */
+    t_symbol        *x_ptyname; /* ...and its path */
+#endif
 } t_comport;
 
 #ifndef TRUE
@@ -128,9 +269,14 @@ typedef struct comport
 #define RXBUFOVERRUN -4
 #define TXBUFOVERRUN -5
 
-#define COMPORT_MAX 99
+#define COMPORT_MAX 256 /* COM ports probed on Windows */
 #define USE_DEVICENAME 9999 /* use the device name instead of the number */
-#define COMPORT_BUF_SIZE 16384 /* this should be the largest possible packet size for a USB com port */
+#define COMPORT_BUF_SIZE 16384 /* default, this should be the largest possible packet size for a USB com port */
+#define COMPORT_BUF_MIN 64
+#define COMPORT_BUF_MAX (64 * 1024 * 1024)
+#define COMPORT_RXRING_READS 4 /* the receive ring has room for several reads between two ticks */
+#define COMPORT_STAMPS 4096 /* reads between two ticks that keep their own timestamp */
+#define COMPORT_FRAMEMAX 4096 /* default maximum size of a received frame */
 
 #ifdef _WIN32
 /* we don't use the  table for msw, because we can set the number directly. */
@@ -155,99 +301,6 @@ static long baudspeedbittable[] =
 };
 */
 #else /* _WIN32 */
-
-#ifdef  IRIX
-#define OPENPARAMS (O_RDWR|O_NDELAY|O_NOCTTY)
-#define TIONREAD FIONREAD         /* re map the IOCTL function */
-#define BAUDRATE_230400 -1
-#define BAUDRATE_115200 -1
-#define BAUDRATE_57600  -1
-#define BAUDRATE_38400  B38400
-#else /* IRIX */
-#define OPENPARAMS (O_RDWR|O_NDELAY|O_NOCTTY)
-#define BAUDRATE_230400 B230400
-#define BAUDRATE_115200 B115200
-#define BAUDRATE_57600  B57600
-#define BAUDRATE_38400  B38400
-#endif /* else IRIX */
-
-typedef struct baudbits_ {
-  long rate;
-  long speedbits;
-} baudbits_t;
-
-static
-baudbits_t baudbitstable[] = {
-#ifdef B4000000
-  {4000000, B4000000},
-#endif
-#ifdef B3500000
-  {3500000, B3500000},
-#endif
-#ifdef B3000000
-  {3000000, B3000000},
-#endif
-#ifdef B2500000
-  {2500000, B2500000},
-#endif
-#ifdef B2000000
-  {2000000, B2000000},
-#endif
-#ifdef B1500000
-  {1500000, B1500000},
-#endif
-#ifdef B1152000
-  {1152000, B1152000},
-#endif
-#ifdef B1000000
-  {1000000, B1000000},
-#endif
-#ifdef B921600
-  {921600, B921600},
-#endif
-#ifdef B576000
-  {576000, B576000},
-#endif
-#ifdef B500000
-  {500000, B500000},
-#endif
-#ifdef B460800
-  {460800, B460800},
-#endif
-#ifdef B230400
-  {230400, B230400},
-#else
-  /* previously, this was supported without an #ifdef */
-# warning baudrate 230400 not supported (anymore)?
-#endif
-#ifdef B115200
-  {115200, B115200},
-#endif
-#ifdef B57600
-  {57600, B57600},
-#endif
-#ifdef B38400
-  {38400, B38400},
-#endif
-  {19200, B19200},
-  {9600, B9600},
-  {4800, B4800},
-  {2400, B2400},
-  {1800, B1800},
-  {1200, B1200},
-  {600, B600},
-  {300, B300},
-  {200, B200},
-  {150, B150},
-  {134, B134},
-  {110, B110},
-  {75, B75},
-  {50, B50},
-  {0, B0}
-};
-
-
-
 struct timeval null_tv;
 
 #endif /* else _WIN32 */
@@ -296,22 +349,70 @@ static int set_rts(t_comport *x, int nr);
 static int set_xonxoff(t_comport *x, int nr);
 static int set_serial(t_comport *x);
 static int set_hupcl(t_comport *x, int nr);
+static int get_real_baudrate(t_comport *x);
+static int set_lowlatency(t_comport *x, HANDLE fd, int on, int timer);
+static void restore_lowlatency(t_comport *x, HANDLE fd);
+static int get_lowlatency(t_comport *x, int *timer);
 static int write_serial(t_comport *x, unsigned char serial_byte);
-static int write_serials(t_comport *x, unsigned char *serial_buf, int buf_length);
+static void comport_txflush(t_comport *x);
+static void comport_txwatermark(t_comport *x);
 static int comport_get_dsr(t_comport *x);
 static int comport_get_cts(t_comport *x);
+static int comport_start_thread(t_comport *x);
+static void comport_stop_thread(t_comport *x);
+static int comport_start_pollfn(t_comport *x);
+static void comport_stop_pollfn(t_comport *x);
+static int comport_start_shared(t_comport *x);
+static void comport_stop_shared(t_comport *x);
+static void comport_drain_rxring(t_comport *x);
+static int comport_start_writer(t_comport *x);
+static void comport_stop_writer(t_comport *x);
+static void comport_wake_writer(t_comport *x);
+static void comport_sendat_lock(t_comport *x);
+static void comport_sendat_unlock(t_comport *x);
+static void comport_sendat_arm(t_comport *x);
+static void comport_start_io(t_comport *x);
+static void comport_stop_io(t_comport *x);
+static void comport_identify(t_comport *x);
+static int comport_reconnect_start(t_comport *x);
+static void comport_cancel(t_comport *x);
+static void comport_worker_free(t_comport *x);
+static int comport_isopen(t_comport *x);
 #ifdef _WIN32
 static HANDLE open_serial(unsigned int com_num, t_comport *x);
 static HANDLE close_serial(t_comport *x);
 #else
 static int open_serial(unsigned int com_num, t_comport *x);
 static int close_serial(t_comport *x);
-static long get_baud_ratebits(t_comport*x, long *baud);
 #endif
 static void comport_pollintervall(t_comport *x, t_floatarg g);
+static void comport_iomode(t_comport *x, t_symbol *s);
+static void comport_stats(t_comport *x, t_symbol *s);
+static void comport_txmode(t_comport *x, t_symbol *s);
+static void comport_set_txwindow(t_comport *x, t_floatarg f);
+static void comport_blockmode(t_comport *x, t_floatarg f, t_floatarg size);
+static void comport_frame(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_framemax(t_comport *x, t_floatarg f);
+static void comport_decode(t_comport *x, t_symbol *s);
+static void comport_unpack(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_checksum(t_comport *x, t_symbol *s, t_floatarg skip);
+static void comport_txwatermarks(t_comport *x, t_floatarg high, t_floatarg low);
+static void comport_encode(t_comport *x, t_symbol *s);
+static void comport_timestamp(t_comport *x, t_floatarg f);
+static void comport_output_bytes(t_comport *x, const unsigned char *buf, int len);
+static int comport_connection_lost(t_comport *x);
 static void comport_tick(t_comport *x);
 static void comport_float(t_comport *x, t_float f);
 static void comport_list(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_pack(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_writearray(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_sendat(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_sendat_tick(t_comport *x);
+static void comport_txarray_fill(t_comport *x);
+static void comport_recordarray(t_comport *x, t_symbol *s, int argc, t_atom *argv);
+static void comport_record(t_comport *x, const unsigned char *buf, int len);
+static void comport_record_redraw(t_comport *x);
+static int comport_txbusy(t_comport *x);
 static void *comport_new(t_symbol *s, int argc, t_atom *argv);
 static void comport_free(t_comport *x);
 static void comport_baud(t_comport *x,t_floatarg f);
@@ -324,8 +425,12 @@ static void comport_rts(t_comport *x,t_floatarg f);
 static void comport_break(t_comport *x,t_floatarg f);
 static void comport_xonxoff(t_comport *x,t_floatarg f);
 static void comport_hupcl(t_comport *x,t_floatarg f);
+static void comport_lowlatency(t_comport *x, t_floatarg f, t_floatarg timer);
 static void comport_close(t_comport *x);
 static void comport_open(t_comport *x, t_floatarg f);
+static void comport_open_device(t_comport *x, unsigned int com_num);
+static void comport_free_buffers(t_comport *x);
+static void comport_buffersize(t_comport *x, t_floatarg rx, t_floatarg tx);
 static void comport_devicename(t_comport *x, t_symbol *s);
 static void comport_print(t_comport *x, t_symbol *s, int argc, t_atom *argv);
 static void comport_output_status(t_comport *x, t_symbol *selector, t_float output_value);
@@ -333,6 +438,7 @@ static void comport_output_port_status(t_comport *x);
 static void comport_output_dsr_status(t_comport *x);
 static void comport_output_cts_status(t_comport *x);
 static void comport_output_baud_rate(t_comport *x);
+static void comport_output_real_baud_rate(t_comport *x);
 static void comport_output_parity_bit(t_comport *x);
 static void comport_output_stop_bits(t_comport *x);
 static void comport_output_data_bits(t_comport *x);
@@ -340,6 +446,7 @@ static void comport_output_rtscts(t_comport *x);
 static void comport_output_xonxoff(t_comport *x);
 static void comport_output_hupcl(t_comport *x);
 static void comport_output_rxerrors(t_comport *x);
+static void comport_output_open_status(t_comport *x);
 static void comport_enum(t_comport *x);
 static void comport_info(t_comport *x);
 static void comport_devices(t_comport *x);
@@ -348,10 +455,6 @@ static void comport_set_verbose(t_comport *x, t_floatarg f);
 static void comport_help(t_comport *x);
 void comport_setup(void);
 
-/* --------- sys independent serial setup helpers ---------------- */
-
-
-
 /* ------------ sys dependent serial setup helpers ---------------- */
 
 
@@ -512,6 +615,32 @@ static int set_hupcl(t_comport *x, int nr)
   return 1;
 }
 
+static int get_real_baudrate(t_comport *x)
+{
+    return x->baud;
+}
+
+/* the driver doesn't batch input on Windows (or does so regardless) */
+static int set_lowlatency(t_comport *x, HANDLE fd, int on, int timer)
+{
+    (void)fd; (void)timer;
+    if(on)
+        pd_error(x, "[comport] lowlatency is not supported on Windows");
+    return 0;
+}
+
+static void restore_lowlatency(t_comport *x, HANDLE fd)
+{
+    (void)x; (void)fd;
+}
+
+static int get_lowlatency(t_comport *x, int *timer)
+{
+    (void)x;
+    *timer = -1;
+    return -1;
+}
+
 static HANDLE open_serial(unsigned int com_num, t_comport *x)
 {
     const char* pretty_name = 0;
@@ -735,361 +864,1182 @@ int comport_get_cts(t_comport *x)
     return cts_state;
 }
 
-#else /* NT */
-/* ----------------- POSIX - UNIX ------------------------------ */
+/* the threaded I/O modes are not implemented for Windows (yet) */
+static int comport_start_thread(t_comport *x)
+{
+    (void)x;
+    return 0;
+}
 
-static long get_baud_ratebits(t_comport *x, long *baud)
+static void comport_stop_thread(t_comport *x)
 {
-    unsigned int i = 0;
-    const unsigned int tablelen = sizeof(baudbitstable) / sizeof(*baudbitstable);
+    (void)x;
+}
+
+static int comport_start_pollfn(t_comport *x)
+{
+    (void)x;
+    return 0;
+}
 
-    while(i < tablelen && baudbitstable[i].rate > *baud) i++;
+static void comport_stop_pollfn(t_comport *x)
+{
+    (void)x;
+}
 
-    if(baudbitstable[i].rate != *baud)
-        pd_error(x, "[comport]: %ld not valid, using closest value: %ld", *baud, baudbitstable[i].rate);
+static int comport_start_shared(t_comport *x)
+{
+    (void)x;
+    return 0;
+}
 
-    /* nearest Baudrate finding */
-    if(i==tablelen ||  baudbitstable[i].rate < 0)
-    {
-        pd_error(x, "*Warning* The baud rate %ld is not supported or out of range, using 9600\n",*baud);
-	*baud = 9600;
-	return B9600;
-    }
+static void comport_stop_shared(t_comport *x)
+{
+    (void)x;
+}
+
+static int comport_start_writer(t_comport *x)
+{
+    (void)x;
+    return 0;
+}
 
-    *baud =  baudbitstable[i].rate;
-    return baudbitstable[i].speedbits;
+static void comport_stop_writer(t_comport *x)
+{
+    (void)x;
 }
 
-static int set_baudrate(t_comport *x, int ibaud)
+static void comport_wake_writer(t_comport *x)
+{
+    (void)x;
+}
+
+/* ...so the timed queue of sendat isn't shared with anyone */
+static void comport_sendat_lock(t_comport *x)
+{
+    (void)x;
+}
+
+static void comport_sendat_unlock(t_comport *x)
+{
+    (void)x;
+}
+
+/* neither is reconnecting... */
+static void comport_identify(t_comport *x)
+{
+    (void)x;
+}
+
+static int comport_reconnect_start(t_comport *x)
+{
+    (void)x;
+    return 0;
+}
+
+/* nor is there a worker, everything happens right away */
+static void comport_cancel(t_comport *x)
+{
+    (void)x;
+}
+
+static void comport_worker_free(t_comport *x)
+{
+    (void)x;
+}
+
+static int comport_isopen(t_comport *x)
+{
+    return x->comhandle != INVALID_HANDLE_VALUE;
+}
+
+#else /* NT */
+/* ----------------- POSIX - UNIX ------------------------------ */
+
+/* the settings live in x_config, libcomport does the work */
+
+/* the rate the driver actually uses (as far as it tells us) */
+static int get_real_baudrate(t_comport *x)
 {
-    struct termios  *tio = &(x->com_termio);
-    long            baud = ibaud;
-    long        baudbits = get_baud_ratebits(x, &baud);
+    long baud = -1;
+    if(x->comhandle != INVALID_HANDLE_VALUE)
+        baud = comserial_get_baudrate(x->comhandle);
+    return (baud > 0) ? (int)baud : x->baud;
+}
 
-    comport_verbose("[comport] set_baudrate: Setting baud rate to %g with baudbits 0x%X", baud, baudbits);
-    if( cfsetispeed(tio, baudbits) != 0 )
-        pd_error(x, "[comport]: ERROR failed to set bitrate: %ld", baudbits);
-    if( cfsetospeed(tio, baudbits) != 0 )
-        pd_error(x, "[comport]: ERROR failed to set bitrate: %ld", baudbits);
+static int set_baudrate(t_comport *x, int ibaud)
+{
+    long baud = comserial_set_baudrate(&x->x_config, ibaud);
 
+    if(baud != ibaud)
+        pd_error(x, "[comport]: %d not valid, using closest value: %ld", ibaud, baud);
+    comport_verbose("[comport] set_baudrate: Setting baud rate to %ld%s", baud,
+        x->x_config.c_custom_baud ? " via BOTHER" : "");
     return baud;
 }
 
 /* bits are 5,6,7,8(default) */
-
 static int set_bits(t_comport *x, int nr)
 {
-    struct termios *tio = &(x->com_termio);
-    tio->c_cflag &= ~CSIZE;
-    switch(nr)
-    {
-        case 5: tio->c_cflag |= CS5; return 5;
-        case 6: tio->c_cflag |= CS6; return 6;
-        case 7: tio->c_cflag |= CS7; return 7;
-        default: tio->c_cflag |= CS8;
-    }
-    return 8;
+    return comserial_set_databits(&x->x_config, nr);
 }
 
-
 /* 1 ... Parity even, -1 parity odd , 0 (default) no parity */
 static int set_parity(t_comport *x, int n)
 {
-    struct termios *tio = &(x->com_termio);
-
-    switch(n)
-    {
-        case 1:
-            tio->c_cflag |= PARENB;  tio->c_cflag &= ~PARODD; return 1;
-        case -1:
-            tio->c_cflag |= PARENB | PARODD; return -1;
-        default:
-            tio->c_cflag &= ~PARENB;
-    }
-    return 0;
+    return comserial_set_parity(&x->x_config, n);
 }
 
-
 /* activate second stop bit with 1, 0(default)*/
 static float set_stopflag(t_comport *x, t_float f_nr)
 {
-    int nr = (int)f_nr;
-    struct termios *tio = &(x->com_termio);
-
-    if(nr == 1)
-    {
-        tio->c_cflag |= CSTOPB;
-        return 1;
-    }
-    else tio->c_cflag &= ~CSTOPB;
-
-    return 0;
+    return comserial_set_stopbits(&x->x_config, (int)f_nr);
 }
 
 /* never tested */
 static int set_ctsrts(t_comport *x, int nr)
 {
-    struct termios *tio = &(x->com_termio);
+    return comserial_set_rtscts(&x->x_config, nr);
+}
 
-    if(nr == 1)
-    {
-        tio->c_cflag |= CRTSCTS;
-        return 1;
-    }
-    tio->c_cflag &= ~CRTSCTS;
-    return 0;
+static int set_xonxoff(t_comport *x, int nr)
+{
+    return comserial_set_xonxoff(&x->x_config, nr);
 }
 
 static int set_dtr(t_comport *x, int nr)
 {
-    int fd = x->comhandle;
-    int status;
-
-    if (fd == INVALID_HANDLE_VALUE) return -1;
-
-    ioctl(fd, TIOCMGET, &status);
-     if (nr == 0)
-        status &= ~TIOCM_DTR;
-    else
-        status |= TIOCM_DTR;
-    ioctl(fd, TIOCMSET, &status);
+    if (x->comhandle == INVALID_HANDLE_VALUE) return -1;
+    comserial_set_modem(x->comhandle, TIOCM_DTR, nr);
     return (nr !=0);
 }
 
 static int set_rts(t_comport *x, int nr)
 {
-    int fd = x->comhandle;
-    int status;
-
-    if (fd == INVALID_HANDLE_VALUE) return -1;
-
-    ioctl(fd, TIOCMGET, &status);
-    if (nr == 0)
-        status &= ~TIOCM_RTS;
-    else
-        status |= TIOCM_RTS;
-    ioctl(fd, TIOCMSET, &status);
+    if (x->comhandle == INVALID_HANDLE_VALUE) return -1;
+    comserial_set_modem(x->comhandle, TIOCM_RTS, nr);
     return (nr !=0);
 }
 
-static int set_xonxoff(t_comport *x, int nr)
+static int set_hupcl(t_comport *x, int nr)
 {
-    struct termios *tio = &(x->com_termio);
-
-    if(nr == 1)
+    if(!comserial_set_hupcl(x->comhandle, nr))
     {
-        tio->c_iflag |= (IXON | IXOFF | IXANY);
-        return 1;
+        pd_error(x,"[comport] could not set HUPCL: %s", strerror(errno));
+        return 0;
     }
+    x->hupcl = nr;
+    return 1;
+}
 
-    tio->c_iflag &= ~IXON & ~IXOFF &  ~IXANY;
-    return 0;
+static int set_break(t_comport *x, int on)
+{
+    if (x->comhandle == INVALID_HANDLE_VALUE) return -1;
+    if (!comserial_set_break(x->comhandle, on)) return -1;
+    return (on != 0);
 }
 
-static int set_hupcl(t_comport *x, int nr)
+static int set_lowlatency(t_comport *x, int fd, int on, int timer)
 {
-    struct termios  settings;
-    int             result;
+    const char  *device = x->serial_device->s_name;
+    int         current, ok = 1;
 
-    result = tcgetattr(x->comhandle, &settings);
-    if (result < 0)
+    if(fd == INVALID_HANDLE_VALUE) return 0;
+    if((current = comserial_get_lowlatency(fd)) < 0)
     {
-        perror ("error in tcgetattr");
-        return 0;
+#ifdef __linux__
+        if(on) /* e.g. a pty or a CDC device */
+            comport_verbose("[comport] %s has no serial_struct, can't set ASYNC_LOW_LATENCY", device);
+#else
+        if(on)
+            pd_error(x, "[comport] lowlatency is only supported on Linux");
+#endif
+        ok = 0;
     }
-    settings.c_iflag &= ~HUPCL;
-    if(nr)
-    settings.c_iflag |= HUPCL;
-    result = tcsetattr(x->comhandle, TCSANOW, &settings);
-    if (result < 0)
+    else
     {
-        pd_error(x,"[comport] could not set HUPCL");
-        return 0;
+        if(x->x_lowlatency_saved < 0)
+            x->x_lowlatency_saved = current;
+        if(!comserial_set_lowlatency(fd, on))
+        {
+            pd_error(x, "[comport] could not set ASYNC_LOW_LATENCY: %s", strerror(errno));
+            ok = 0;
+        }
     }
-    x->hupcl = nr;
-    return 1;
+    if(timer > 0 && (current = comserial_get_latency_timer(device)) >= 0)
+    {
+        if(x->x_latency_timer_saved < 0)
+            x->x_latency_timer_saved = current;
+        if(current != timer && !comserial_set_latency_timer(device, timer))
+        {
+            pd_error(x, "[comport] could not set the latency timer of %s: %s", device, strerror(errno));
+            ok = 0;
+        }
+    }
+    return ok;
 }
 
-static int set_break(t_comport *x, int on)
+/* leave the device the way we found it */
+static void restore_lowlatency(t_comport *x, int fd)
 {
-    int fd = x->comhandle;
-    int status;
+    const char *device = x->serial_device->s_name;
+
+    if(x->x_lowlatency_saved >= 0 && fd != INVALID_HANDLE_VALUE)
+        comserial_set_lowlatency(fd, x->x_lowlatency_saved);
+    if(x->x_latency_timer_saved >= 0
+        && comserial_get_latency_timer(device) != x->x_latency_timer_saved)
+        comserial_set_latency_timer(device, x->x_latency_timer_saved);
+    x->x_lowlatency_saved = -1;
+    x->x_latency_timer_saved = -1;
+}
 
-    if (fd == INVALID_HANDLE_VALUE) return -1;
+/* returns the ASYNC_LOW_LATENCY flag (-1 if unknown) and the latency timer */
+static int get_lowlatency(t_comport *x, int *timer)
+{
+    *timer = -1;
+    if(x->comhandle == INVALID_HANDLE_VALUE) return -1;
+    *timer = comserial_get_latency_timer(x->serial_device->s_name);
+    return comserial_get_lowlatency(x->comhandle);
+}
 
-    if (on == 0)
-      status = ioctl(fd, TIOCCBRK); // Turn break off, that is, stop sending zero bits.
-    else
-      status = ioctl(fd, TIOCSBRK); // Turn break on, that is, start sending zero bits.
+/* ------------------- device index ------------------------- */
+
+/* the devices matching a glob pattern, shared by all objects using the
+   same pattern. on Linux, inotify tells us when a directory changes, so
+   looking up a port doesn't touch the filesystem. other systems re-glob
+   on every lookup (and report what changed right after it), but still
+   remember which devices are usable */
+
+#define COMDEV_UNKNOWN 0
+#define COMDEV_USABLE 1 /* open() and tcgetattr() worked */
+#define COMDEV_UNUSABLE 2
+
+typedef struct comdevices
+{
+    t_symbol            *d_pattern;
+    t_symbol            **d_names; /* sorted, as glob() returns them */
+    char                *d_usable; /* COMDEV_... for each name */
+    int                 d_count;
+    int                 *d_hash; /* name -> index + 1, open addressing */
+    int                 d_hashsize; /* power of 2, 0 if there are no names */
+    int                 d_watch; /* inotify watch of the directory, -1 if none */
+    t_bool              d_stale; /* must re-glob before the next lookup */
+    struct comdevices   *d_next;
+} t_comdevices;
+
+static t_comdevices *comdevices_list = NULL;
+#ifdef __linux__
+static int comdevices_inotify = -1;
+#endif
+static t_comport *comport_instances = NULL; /* all objects, to tell them about hot-plugging */
+static t_symbol **comdevices_events = NULL; /* pattern, attached/detached, name */
+static int comdevices_nevents = 0;
+static int comdevices_eventsize = 0;
+static t_clock *comdevices_clock = NULL; /* reports what a lookup found */
 
-    return ((status < 0)? status: (on != 0));
+static int comdevices_hashfn(const t_symbol *s, int size)
+{
+    size_t h = (size_t)s;
+    h ^= h >> 7;
+    h *= 2654435761u;
+    return (int)((h >> 4) & (size - 1));
 }
 
-static int open_serial(unsigned int com_num, t_comport *x)
+static int comdevices_find(const t_comdevices *d, const t_symbol *name)
 {
-    int             fd;
-    unsigned int    i;
-    struct termios  *old = &(x->oldcom_termio);
-    struct termios  *new = &(x->com_termio);
-    int             *baud = &(x->baud);
-    glob_t          glob_buffer;
+    int h;
+    if(0 == d->d_hashsize) return -1;
+    for(h = comdevices_hashfn(name, d->d_hashsize); d->d_hash[h]; h = (h + 1) & (d->d_hashsize - 1))
+        if(d->d_names[d->d_hash[h] - 1] == name)
+            return d->d_hash[h] - 1;
+    return -1;
+}
+
+static void comdevices_free_arrays(t_symbol **names, char *usable, int count, int *hash, int hashsize)
+{
+    if(names) freebytes(names, count * sizeof(*names));
+    if(usable) freebytes(usable, count);
+    if(hash) freebytes(hash, hashsize * sizeof(*hash));
+}
+
+static int comdevices_isinstance(const t_comport *x)
+{
+    const t_comport *y;
+    for(y = comport_instances; y; y = y->x_next_instance)
+        if(y == x)
+            return 1;
+    return 0;
+}
 
-    /* if com_num == USE_DEVICENAME, use device name directly, else try port # */
-    if((com_num != USE_DEVICENAME)&&(com_num >= COMPORT_MAX))
+/* remember that a device came or went, to tell the objects later */
+static void comdevices_report(t_symbol *pattern, const char *what, t_symbol *name)
+{
+    if(comdevices_nevents == comdevices_eventsize)
     {
-        pd_error(x, "[comport] ** WARNING ** port %d not valid, must be between 0 and %d",
-            com_num, COMPORT_MAX - 1);
-        return INVALID_HANDLE_VALUE;
+        int      size = comdevices_eventsize ? 2 * comdevices_eventsize : 16;
+        t_symbol **events = resizebytes(comdevices_events,
+            3 * comdevices_eventsize * sizeof(*events), 3 * size * sizeof(*events));
+        if(NULL == events) return;
+        comdevices_events = events;
+        comdevices_eventsize = size;
     }
-    /*  post("[comport] globbing %s",x->serial_device_prefix);*/
-    /* get the device path based on the port# and the glob pattern */
-    switch( glob( x->serial_device_prefix, 0, NULL, &glob_buffer ) )
+    comdevices_events[3 * comdevices_nevents] = pattern;
+    comdevices_events[3 * comdevices_nevents + 1] = gensym(what);
+    comdevices_events[3 * comdevices_nevents++ + 2] = name;
+}
+
+/* tell all objects using the patterns about the reported devices. this is
+   only done from the poll function or a clock, never while a method is
+   looking something up. whoever receives it may delete any [comport], and
+   with the last one the index and the reports go away, so the reports are
+   taken first, only the objects to tell are remembered, and each is
+   checked again before it is told */
+static void comdevices_flush(void)
+{
+    t_symbol    **events = comdevices_events;
+    int         nevents = comdevices_nevents, eventsize = comdevices_eventsize;
+    t_comport   *x, **targets = NULL;
+    int         i, j, ntargets = 0;
+
+    if(0 == nevents) return;
+    comdevices_events = NULL;
+    comdevices_nevents = comdevices_eventsize = 0;
+    for(x = comport_instances; x; x = x->x_next_instance)
+        ntargets++;
+    if(ntargets && NULL != (targets = getbytes(ntargets * sizeof(*targets))))
+    {
+        for(x = comport_instances, j = 0; x; x = x->x_next_instance)
+            targets[j++] = x;
+        for(i = 0; i < nevents; i++)
+            for(j = 0; j < ntargets; j++)
+            {
+                t_atom at;
+                x = targets[j];
+                if(!comdevices_isinstance(x)
+                    || strcmp(x->serial_device_prefix, events[3 * i]->s_name))
+                    continue;
+                SETSYMBOL(&at, events[3 * i + 2]);
+                outlet_anything(x->x_status_outlet, events[3 * i + 1], 1, &at);
+            }
+        freebytes(targets, ntargets * sizeof(*targets));
+    }
+    freebytes(events, 3 * eventsize * sizeof(*events));
+}
+
+static void comdevices_tick(void *dummy)
+{
+    (void)dummy;
+    comdevices_flush();
+}
+
+/* re-read the list of devices, report the differences (see
+   comdevices_report()) if 'notify' is set. 'x' is only used for error
+   messages, if NULL there are none */
+static void comdevices_glob(t_comdevices *d, t_comport *x, int notify)
+{
+    glob_t      glob_buffer;
+    t_symbol    **oldnames = d->d_names;
+    char        *oldusable = d->d_usable;
+    int         oldcount = d->d_count;
+    int         *oldhash = d->d_hash;
+    int         oldhashsize = d->d_hashsize;
+    t_comdevices old;
+    int         i, count;
+
+    memset(&old, 0, sizeof(old));
+
+    switch( glob( d->d_pattern->s_name, 0, NULL, &glob_buffer ) )
     {
+        case 0:
+            break;
         case GLOB_NOSPACE:
-            pd_error(x,"[comport] out of memory for \"%s\"",x->serial_device_prefix);
+            if(x) pd_error(x,"[comport] out of memory for \"%s\"", d->d_pattern->s_name);
             break;
 #ifdef GLOB_ABORTED
         case GLOB_ABORTED:
-            pd_error(x,"[comport] aborted \"%s\"",x->serial_device_prefix);
+            if(x) pd_error(x,"[comport] aborted \"%s\"", d->d_pattern->s_name);
             break;
 #endif
 #ifdef GLOB_NOMATCH
         case GLOB_NOMATCH:
-            pd_error(x,"[comport] no serial devices found for \"%s\"",
-                     x->serial_device_prefix);
+            if(x) pd_error(x,"[comport] no serial devices found for \"%s\"", d->d_pattern->s_name);
             break;
 #endif
     }
-    if (com_num == USE_DEVICENAME)
-    { /* if possible, find the index of the devicename */
-        for (i = 0; i < glob_buffer.gl_pathc; ++i)
+    count = glob_buffer.gl_pathc;
+    d->d_count = 0;
+    d->d_names = NULL;
+    d->d_usable = NULL;
+    d->d_hash = NULL;
+    d->d_hashsize = 0;
+    if(count > 0)
+    {
+        d->d_names = getbytes(count * sizeof(*d->d_names));
+        d->d_usable = getbytes(count);
+        for(d->d_hashsize = 1; d->d_hashsize < 2 * count; d->d_hashsize <<= 1);
+        d->d_hash = getbytes(d->d_hashsize * sizeof(*d->d_hash));
+        if(!d->d_names || !d->d_usable || !d->d_hash)
         {
-            if (0 == strcmp(x->serial_device->s_name, glob_buffer.gl_pathv[i]))
-            {
-                com_num = i;
-                break;
-            }
+            comdevices_free_arrays(d->d_names, d->d_usable, count, d->d_hash, d->d_hashsize);
+            d->d_names = NULL;
+            d->d_usable = NULL;
+            d->d_hash = NULL;
+            d->d_hashsize = 0;
+            count = 0;
         }
     }
-    else if(com_num < glob_buffer.gl_pathc)
-        x->serial_device = gensym(glob_buffer.gl_pathv[com_num]);
-    else
+    /* the old index, to carry over what we know */
+    old.d_names = oldnames;
+    old.d_hash = oldhash;
+    old.d_hashsize = oldhashsize;
+    for(i = 0; i < count; i++)
     {
-        pd_error(x, "[comport] ** WARNING ** port #%d does not exist! (max == %lu)",
-                 com_num,(unsigned long)(glob_buffer.gl_pathc - 1));
-        return INVALID_HANDLE_VALUE;
+        t_symbol *name = gensym(glob_buffer.gl_pathv[i]);
+        int      h, j = comdevices_find(&old, name);
+
+        d->d_names[i] = name;
+        /* without a watch there's no telling when permissions change, so
+           try the unusable ones again */
+        d->d_usable[i] = (j >= 0 && (d->d_watch >= 0 || COMDEV_USABLE == oldusable[j]))
+            ? oldusable[j] : COMDEV_UNKNOWN;
+        for(h = comdevices_hashfn(name, d->d_hashsize); d->d_hash[h]; h = (h + 1) & (d->d_hashsize - 1));
+        d->d_hash[h] = i + 1;
     }
+    d->d_count = count;
+    d->d_stale = (d->d_watch < 0);
     globfree( &(glob_buffer) );
 
-    if((fd = open(x->serial_device->s_name, OPENPARAMS)) == INVALID_HANDLE_VALUE)
+    if(notify)
     {
-        pd_error(x, "[comport] ** ERROR ** could not open device %s:\n failure(%d): %s\n",
-            x->serial_device->s_name,errno,strerror(errno));
-        return INVALID_HANDLE_VALUE;
+        for(i = 0; i < oldcount; i++)
+            if(comdevices_find(d, oldnames[i]) < 0)
+                comdevices_report(d->d_pattern, "detached", oldnames[i]);
+        for(i = 0; i < d->d_count; i++)
+            if(comdevices_find(&old, d->d_names[i]) < 0)
+                comdevices_report(d->d_pattern, "attached", d->d_names[i]);
     }
+    comdevices_free_arrays(oldnames, oldusable, oldcount, oldhash, oldhashsize);
+}
 
-    /* set no wait on any operation */
-    fcntl(fd, F_SETFL, FNDELAY);
+#ifdef __linux__
+/* Pd's scheduler calls this when a watched directory has changed */
+static void comdevices_pollfn(void *dummy, int fd)
+{
+    char            buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t         n;
+    t_comdevices    *d;
+    int             i;
+    (void)dummy;
 
-    /*   Save the Current Port Configuration  */
-    if(tcgetattr(fd, old) == -1 || tcgetattr(fd, new) == -1)
+    while((n = read(fd, buf, sizeof(buf))) > 0)
     {
-        pd_error(x,"[comport] ** ERROR ** could not get termios-structure of device %s\n",
-            x->serial_device->s_name);
-        close(fd);
-        return INVALID_HANDLE_VALUE;
+        char *p;
+        for(p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            for(d = comdevices_list; d; d = d->d_next)
+            {
+                if(d->d_watch != ev->wd)
+                    continue;
+                if(ev->mask & IN_ATTRIB)
+                { /* e.g. udev fixed the permissions: probe again */
+                    for(i = 0; i < d->d_count; i++)
+                        if(COMDEV_UNUSABLE == d->d_usable[i])
+                            d->d_usable[i] = COMDEV_UNKNOWN;
+                }
+                if(ev->mask & ~IN_ATTRIB)
+                    d->d_stale = 1;
+                if(ev->mask & IN_IGNORED)
+                    d->d_watch = -1; /* the directory is gone, fall back to globbing */
+            }
+        }
     }
+    for(d = comdevices_list; d; d = d->d_next)
+        if(d->d_stale)
+            comdevices_glob(d, NULL, 1);
+    /* the index is settled by now, and isn't touched anymore */
+    comdevices_flush();
+}
 
-    /* Setup the new port configuration...NON-CANONICAL INPUT MODE
-    .. as defined in termios.h */
-
-    /* enable input and ignore modem controls */
-    new->c_cflag |= (CREAD | CLOCAL);
-#if 1
-    /* always nocanonical, this means raw i/o no terminal */
-    new->c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
+/* watch the directory part of the pattern, if it has no wildcards */
+static void comdevices_watch(t_comdevices *d)
+{
+    char        dir[MAXPDSTRING];
+    char        *slash;
 
-    /* don't process input */
-    if(!x->x_inprocess) {
-        new->c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    d->d_watch = -1;
+    if(comdevices_inotify < 0)
+    {
+        comdevices_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(comdevices_inotify < 0) return;
+        sys_addpollfn(comdevices_inotify, (t_fdpollfn)comdevices_pollfn, NULL);
     }
-
-    /* no post processing */
-    new->c_oflag &= ~OPOST;
+    strncpy(dir, d->d_pattern->s_name, MAXPDSTRING - 1);
+    dir[MAXPDSTRING - 1] = 0;
+    if(NULL == (slash = strrchr(dir, '/')) || slash == dir) return;
+    *slash = 0;
+    if(strpbrk(dir, "*?[\\")) return;
+    d->d_watch = inotify_add_watch(comdevices_inotify, dir,
+        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB);
+}
 #else
-    /* set to raw mode */
-    if(!x->x_inprocess) {
-        cfmakeraw(new);
-    }
-#endif
-    /* setup to return after 0 seconds
-        ..if no characters are received
-        TIME units are assumed to be 0.1 secs */
-    /* not needed anymore ??? in new termios in linux
-    new->c_cc[VMIN] = 0;
-    new->c_cc[VTIME] = 0;
-    */
-
-    /* defaults, see input */
-
-    set_bits(x, x->data_bits);      /* CS8 */
-    set_stopflag(x, x->stop_bits);  /* ~CSTOPB */
-    set_ctsrts(x, x->ctsrts);  /* ~CRTSCTS;*/
-    set_xonxoff(x, x->xonxoff); /* (IXON | IXOFF | IXANY) */
-    set_baudrate(x, *baud);
+static void comdevices_watch(t_comdevices *d)
+{
+    d->d_watch = -1;
+}
+#endif /* __linux__ */
 
-    x->x_retry_count = 0; /* reset retry counter */
+/* get the (up to date) index for a pattern */
+static t_comdevices *comdevices_get(t_comport *x, const char *pattern)
+{
+    t_symbol        *s = gensym(pattern);
+    t_comdevices    *d;
 
-    if(tcsetattr(fd, TCSAFLUSH, new) != -1)
+    for(d = comdevices_list; d; d = d->d_next)
+        if(d->d_pattern == s)
+            break;
+    if(NULL == d)
     {
-        comport_verbose("[comport] opened serial line device %d (%s)\n",
-            com_num,x->serial_device->s_name);
+        if(NULL == (d = getbytes(sizeof(*d))))
+            return NULL;
+        memset(d, 0, sizeof(*d));
+        d->d_pattern = s;
+        comdevices_watch(d);
+        d->d_stale = 1;
+        d->d_next = comdevices_list;
+        comdevices_list = d;
+        comdevices_glob(d, x, 0);
     }
-    else
-    {
-        pd_error(x,"[comport] ** ERROR ** could not set params to ioctl of device %s\n",
-            x->serial_device->s_name);
-        close(fd);
-        return INVALID_HANDLE_VALUE;
+    else if(d->d_stale)
+    { /* what changed is told later, not from within a method */
+        comdevices_glob(d, x, 1);
+        if(comdevices_nevents)
+        {
+            if(NULL == comdevices_clock)
+                comdevices_clock = clock_new(NULL, (t_method)comdevices_tick);
+            clock_delay(comdevices_clock, 0);
+        }
     }
-    x->comport = com_num; /* output at next comport_tick */
+    return d;
+}
+
+/* can we talk to it? checked once per device, unusable ones again when
+   their attributes change (or on every glob, if there's no watch) */
+static int comdevices_usable(t_comdevices *d, int i)
+{
+    if(COMDEV_UNKNOWN == d->d_usable[i])
+    {
+        struct termios  test;
+        int             fd = comserial_open(d->d_names[i]->s_name);
+        d->d_usable[i] = COMDEV_UNUSABLE;
+        if(fd != INVALID_HANDLE_VALUE)
+        {
+            if(tcgetattr(fd, &test) != -1)
+                d->d_usable[i] = COMDEV_USABLE;
+            close(fd);
+        }
+    }
+    return COMDEV_USABLE == d->d_usable[i];
+}
+
+static void comdevices_addinstance(t_comport *x)
+{
+    x->x_next_instance = comport_instances;
+    comport_instances = x;
+}
+
+/* the index goes away with the last object */
+static void comdevices_removeinstance(t_comport *x)
+{
+    t_comport **p;
+    for(p = &comport_instances; *p; p = &(*p)->x_next_instance)
+        if(*p == x)
+        {
+            *p = x->x_next_instance;
+            break;
+        }
+    if(comport_instances) return;
+    while(comdevices_list)
+    {
+        t_comdevices *d = comdevices_list;
+        comdevices_list = d->d_next;
+        comdevices_free_arrays(d->d_names, d->d_usable, d->d_count, d->d_hash, d->d_hashsize);
+        freebytes(d, sizeof(*d));
+    }
+    if(comdevices_clock)
+    {
+        clock_free(comdevices_clock);
+        comdevices_clock = NULL;
+    }
+    if(comdevices_events)
+        freebytes(comdevices_events, 3 * comdevices_eventsize * sizeof(*comdevices_events));
+    comdevices_events = NULL;
+    comdevices_nevents = comdevices_eventsize = 0;
+#ifdef __linux__
+    if(comdevices_inotify >= 0)
+    {
+        sys_rmpollfn(comdevices_inotify);
+        close(comdevices_inotify);
+        comdevices_inotify = -1;
+    }
+#endif
+}
+
+/* ---------- stable identities of devices ---------- */
+/* device nodes are numbered in the order they show up, so to find a lost
+   device again we go by comserial_stable_name() */
+
+/* remember how to find the open device again */
+static void comport_identify(t_comport *x)
+{
+    char id[MAXPDSTRING];
+
+    if(x->x_reconnect_id)
+        x->x_identity = x->x_reconnect_id;
+    else if(comserial_stable_name(x->serial_device->s_name, id, sizeof(id)))
+        x->x_identity = gensym(id);
+    else
+        x->x_identity = x->serial_device;
+    comport_verbose("[comport] will reconnect to %s", x->x_identity->s_name);
+}
+
+/* ---------- the worker ---------- */
+/* open(), tcsetattr(TCSAFLUSH) and close() can block for seconds on some
+   devices (bluetooth RFCOMM, some CDC devices, or while output drains), so
+   each object has a worker thread that does them in the order they were
+   submitted. a job carries copies of everything it needs: the worker never
+   touches the object or any Pd API. finished jobs are picked up by the
+   clock, see comport_jobs_poll() */
+
+#define COMPORT_JOB_OPEN 0 /* open j_device */
+#define COMPORT_JOB_RECONNECT 1 /* wait for the device with identity j_device, then open it */
+#define COMPORT_JOB_CONFIG 2 /* apply j_termios to j_fd */
+#define COMPORT_JOB_CLOSE 3 /* restore j_termios and close j_fd */
+
+typedef struct comjob
+{
+    int             j_type; /* COMPORT_JOB_... */
+    int             j_generation; /* the x_generation it was submitted in */
+    t_symbol        *j_device; /* device (or identity) */
+    int             j_comport; /* port# to report */
+    t_comconfig     j_config; /* settings to apply; what was applied */
+    int             j_maxdelay; /* RECONNECT: max. ms between attempts */
+    int             j_fd; /* CONFIG/CLOSE: the device; OPEN/RECONNECT: the result */
+    struct termios  j_old; /* the settings before we opened it */
+    int             j_failed; /* COMSERIAL_FAILED_..., 0 if ok */
+    int             j_error; /* ...and the errno */
+    t_bool          j_speedchanged;
+    char            j_path[MAXPDSTRING]; /* where the device was found */
+    struct comjob   *j_next;
+} t_comjob;
+
+typedef struct comworker
+{
+    pthread_t       w_thread;
+    pthread_mutex_t w_lock;
+    pthread_cond_t  w_cond;
+    t_comjob        *w_todo; /* FIFO of submitted jobs */
+    t_comjob        *w_done; /* FIFO of finished ones, for the Pd thread */
+    t_bool          w_orphaned; /* the object is gone, clean up and quit */
+    int             w_generation; /* jobs of older generations are not wanted anymore */
+    int             w_attempts; /* RECONNECT: failed attempts so far */
+} t_comworker;
+
+static void comjob_append(t_comjob **list, t_comjob *j)
+{
+    j->j_next = NULL;
+    while(*list)
+        list = &(*list)->j_next;
+    *list = j;
+}
+
+static int comjob_config(t_comjob *j)
+{
+    int changed = 0;
+    if((j->j_failed = comserial_configure(j->j_fd, &j->j_config, &changed)))
+    {
+        j->j_error = errno;
+        return 0;
+    }
+    j->j_speedchanged = changed;
+    return 1;
+}
+
+/* j_fd might already be open (a pty), else open 'path' */
+static int comjob_open(t_comjob *j, const char *path)
+{
+    int fd = (j->j_fd != INVALID_HANDLE_VALUE) ? j->j_fd : comserial_open(path);
+    if(fd == INVALID_HANDLE_VALUE)
+    {
+        j->j_failed = COMSERIAL_FAILED_OPEN;
+        j->j_error = errno;
+        return 0;
+    }
+    if((j->j_failed = comserial_setup(fd, &j->j_config, &j->j_old)))
+    {
+        j->j_error = errno;
+        comserial_close(fd, NULL);
+        j->j_fd = INVALID_HANDLE_VALUE;
+        return 0;
+    }
+    j->j_fd = fd;
+    snprintf(j->j_path, sizeof(j->j_path), "%s", path);
+    return 1;
+}
+
+/* wait for a lost device to come back, with exponential backoff */
+static void comjob_reconnect(t_comworker *w, t_comjob *j)
+{
+    int  delay = COMPORT_RECONNECT_DELAY;
+    char path[MAXPDSTRING];
+
+    comport_store_release(&w->w_attempts, 0);
+    while(comport_load_acquire(&w->w_generation) == j->j_generation)
+    {
+        int waited;
+        if(comserial_find_identity(j->j_device->s_name, path, sizeof(path))
+            && comjob_open(j, path))
+            return;
+        comport_store_release(&w->w_attempts, w->w_attempts + 1);
+        /* sleep in slices, to notice in time when we are not wanted anymore */
+        for(waited = 0; waited < delay
+            && comport_load_acquire(&w->w_generation) == j->j_generation; waited += 10)
+        {
+            struct timespec ts;
+            ts.tv_sec = 0;
+            ts.tv_nsec = 10 * 1000000;
+            nanosleep(&ts, NULL);
+        }
+        delay *= 2;
+        if(delay > j->j_maxdelay)
+            delay = j->j_maxdelay;
+    }
+    j->j_failed = COMSERIAL_FAILED_OPEN;
+    j->j_error = ECANCELED;
+}
+
+/* a job whose result no one wants: don't leak the device */
+static void comjob_discard(t_comjob *j)
+{
+    if((j->j_type == COMPORT_JOB_OPEN || j->j_type == COMPORT_JOB_RECONNECT)
+        && j->j_fd != INVALID_HANDLE_VALUE)
+        comserial_close(j->j_fd, &j->j_old);
+    free(j);
+}
+
+static void *comport_worker(void *arg)
+{
+    t_comworker *w = (t_comworker *)arg;
+
+    pthread_mutex_lock(&w->w_lock);
+    while(1)
+    {
+        t_comjob *j;
+        while(!w->w_todo && !w->w_orphaned)
+            pthread_cond_wait(&w->w_cond, &w->w_lock);
+        if(w->w_orphaned)
+        { /* nobody will pick them up */
+            while(NULL != (j = w->w_done))
+            {
+                w->w_done = j->j_next;
+                comjob_discard(j);
+            }
+        }
+        if(NULL == (j = w->w_todo))
+            break; /* orphaned, and nothing left to do */
+        w->w_todo = j->j_next;
+        pthread_mutex_unlock(&w->w_lock);
+
+        switch(j->j_type)
+        {
+            case COMPORT_JOB_OPEN:
+                comjob_open(j, j->j_device->s_name);
+                break;
+            case COMPORT_JOB_RECONNECT:
+                comjob_reconnect(w, j);
+                break;
+            case COMPORT_JOB_CONFIG:
+                comjob_config(j);
+                break;
+            case COMPORT_JOB_CLOSE:
+                comserial_close(j->j_fd, &j->j_config.c_termios);
+                break;
+            default:
+                break;
+        }
+
+        pthread_mutex_lock(&w->w_lock);
+        if(w->w_orphaned)
+            comjob_discard(j);
+        else
+            comjob_append(&w->w_done, j);
+    }
+    pthread_mutex_unlock(&w->w_lock);
+    pthread_mutex_destroy(&w->w_lock);
+    pthread_cond_destroy(&w->w_cond);
+    free(w);
+    return 0;
+}
+
+/* a job with the current settings of the object */
+static t_comjob *comjob_new(t_comport *x, int type)
+{
+    t_comjob *j = (t_comjob *)calloc(1, sizeof(t_comjob));
+    if(NULL == j)
+    {
+        pd_error(x, "[comport]: out of memory");
+        return NULL;
+    }
+    j->j_type = type;
+    j->j_generation = x->x_generation;
+    j->j_device = x->serial_device;
+    j->j_comport = x->comport;
+    j->j_config = x->x_config;
+    j->j_config.c_inprocess = x->x_inprocess;
+    j->j_maxdelay = x->x_reconnect_maxdelay;
+    j->j_fd = INVALID_HANDLE_VALUE;
+    return j;
+}
+
+/* hand a job to the worker (which is started when it's needed first) */
+static int comport_submit(t_comport *x, t_comjob *j)
+{
+    t_comworker *w = x->x_worker;
+
+    if(NULL == w)
+    {
+        if(NULL == (w = (t_comworker *)calloc(1, sizeof(t_comworker))))
+        {
+            pd_error(x, "[comport]: out of memory");
+            free(j);
+            return 0;
+        }
+        pthread_mutex_init(&w->w_lock, 0);
+        pthread_cond_init(&w->w_cond, 0);
+        w->w_generation = x->x_generation;
+        if(pthread_create(&w->w_thread, 0, comport_worker, w) != 0)
+        {
+            pd_error(x, "[comport]: could not start worker thread: %s", strerror(errno));
+            pthread_mutex_destroy(&w->w_lock);
+            pthread_cond_destroy(&w->w_cond);
+            free(w);
+            free(j);
+            return 0;
+        }
+        x->x_worker = w;
+    }
+    pthread_mutex_lock(&w->w_lock);
+    comjob_append(&w->w_todo, j);
+    pthread_cond_signal(&w->w_cond);
+    pthread_mutex_unlock(&w->w_lock);
+
+    x->x_jobs++;
+    clock_delay(x->x_clock, x->x_deltime); /* to pick up the result */
+    return 1;
+}
+
+/* forget about pending opens and reconnects */
+static void comport_cancel(t_comport *x)
+{
+    x->x_generation++;
+    x->x_opening = x->x_reconnecting = 0;
+    if(x->x_worker)
+        comport_store_release(&x->x_worker->w_generation, x->x_generation);
+}
+
+/* the object is going away: the worker finishes closing the device on its own */
+static void comport_worker_free(t_comport *x)
+{
+    t_comworker *w = x->x_worker;
+    if(NULL == w) return;
+
+    pthread_detach(w->w_thread); /* before it can free itself */
+    pthread_mutex_lock(&w->w_lock);
+    w->w_orphaned = 1;
+    pthread_cond_signal(&w->w_cond);
+    pthread_mutex_unlock(&w->w_lock);
+    x->x_worker = NULL;
+}
+
+/* let the worker restore the settings 'tio' and close 'fd' */
+static void comport_close_fd(t_comport *x, int fd, const struct termios *tio)
+{
+    t_comjob *j = comjob_new(x, COMPORT_JOB_CLOSE);
+    if(j)
+    {
+        j->j_fd = fd;
+        j->j_config.c_termios = *tio;
+        if(comport_submit(x, j))
+            return;
+    }
+    /* no worker, do it ourselves */
+    comserial_close(fd, tio);
+}
+
+/* an opened (or reconnected) device is ready to be used */
+static void comport_install(t_comport *x, t_comjob *j)
+{
+    t_comconfig want = x->x_config;
+
+    x->comhandle = j->j_fd;
+    x->oldcom_termio = j->j_old;
+    x->x_config.c_termios = j->j_config.c_termios;
+    if(j->j_type == COMPORT_JOB_RECONNECT)
+    {
+        t_comdevices *devices = comdevices_get(x, x->serial_device_prefix);
+        x->serial_device = gensym(j->j_path);
+        if(devices)
+        {
+            int i = comdevices_find(devices, x->serial_device);
+            if(i >= 0)
+                x->comport = i;
+        }
+    }
+    else
+        x->comport = j->j_comport;
     x->pretty_name = x->serial_device->s_name;
+    x->x_retry_count = 0;
+    if(x->x_lowlatency)
+        set_lowlatency(x, x->comhandle, 1, x->x_latency_timer);
+    if(j->j_type == COMPORT_JOB_OPEN && x->x_reconnect)
+        comport_identify(x);
+
+    /* settings that were changed while we were waiting */
+    comserial_merge(&x->x_config.c_termios, &want, 0);
+    if(memcmp(&x->x_config.c_termios, &j->j_config.c_termios, sizeof(struct termios))
+        || x->x_config.c_custom_baud != j->j_config.c_custom_baud)
+        set_serial(x);
+
+    comport_start_io(x);
+    if(comring_used(&x->x_txring)) /* written while we were waiting */
+        comport_wake_writer(x);
+}
 
-    return fd;
+static void comport_job_done(t_comport *x, t_comjob *j)
+{
+    static const char *what[] = {"", "open", "get termios-structure of", "set params to ioctl of"};
+    int failed = j->j_failed;
+    if(failed < 0 || failed > 3) failed = 3;
+
+    x->x_jobs--;
+    switch(j->j_type)
+    {
+        case COMPORT_JOB_OPEN:
+        case COMPORT_JOB_RECONNECT:
+            if(j->j_generation != x->x_generation)
+            { /* closed (or reopened) in the meantime: leave it like we found it */
+                if(j->j_fd != INVALID_HANDLE_VALUE)
+                    comport_close_fd(x, j->j_fd, &j->j_old);
+                break;
+            }
+            x->x_opening = x->x_reconnecting = 0;
+            if(j->j_failed)
+            {
+                pd_error(x, "[comport] ** ERROR ** could not %s device %s:\n failure(%d): %s\n",
+                    what[failed], j->j_device->s_name, j->j_error, strerror(j->j_error));
+                comport_output_open_status(x);
+                comport_free_buffers(x);
+                break;
+            }
+            comport_install(x, j);
+            if(j->j_type == COMPORT_JOB_RECONNECT)
+            {
+                t_atom at;
+                comport_verbose("[comport] reconnected to %s (%s)", j->j_device->s_name, x->pretty_name);
+                SETSYMBOL(&at, x->serial_device);
+                outlet_anything(x->x_status_outlet, gensym("reconnected"), 1, &at);
+            }
+            else
+                comport_verbose("[comport] opened serial line device %d (%s)\n",
+                    x->comport, x->serial_device->s_name);
+            comport_output_open_status(x);
+            comport_output_port_status(x);
+            break;
+        case COMPORT_JOB_CONFIG:
+            if(j->j_failed)
+                pd_error(x, "[comport] ** ERROR ** could not %s device %s: %s\n",
+                    what[failed], j->j_device->s_name, strerror(j->j_error));
+            else if(j->j_speedchanged && j->j_fd == x->comhandle)
+                comport_output_real_baud_rate(x);
+            break;
+        case COMPORT_JOB_CLOSE:
+            comport_verbose("[comport] closed %s", j->j_device->s_name);
+            if(x->comhandle == INVALID_HANDLE_VALUE && !x->x_opening)
+                comport_output_open_status(x);
+            break;
+        default:
+            break;
+    }
+}
+
+/* pick up what the worker has done */
+static void comport_jobs_poll(t_comport *x)
+{
+    t_comworker *w = x->x_worker;
+    t_comjob    *done;
+
+    if(NULL == w) return;
+    pthread_mutex_lock(&w->w_lock);
+    done = w->w_done;
+    w->w_done = NULL;
+    pthread_mutex_unlock(&w->w_lock);
+
+    while(done)
+    {
+        t_comjob *j = done;
+        done = j->j_next;
+        comport_job_done(x, j);
+        free(j);
+    }
+    if(x->x_reconnecting)
+    {
+        int attempts = comport_load_acquire(&w->w_attempts);
+        if(attempts != x->x_reconnect_attempts_seen)
+        {
+            x->x_reconnect_attempts_seen = attempts;
+            comport_output_status(x, gensym("reconnecting"), attempts);
+        }
+    }
+}
+
+/* wait for the lost device to come back */
+static int comport_reconnect_start(t_comport *x)
+{
+    t_comjob *j;
+    if(x->x_reconnecting) return 1;
+    if(!x->x_identity) return 0;
+
+    if(NULL == (j = comjob_new(x, COMPORT_JOB_RECONNECT)))
+        return 0;
+    j->j_device = x->x_identity;
+    if(!comport_submit(x, j))
+        return 0;
+    x->x_opening = x->x_reconnecting = 1;
+    x->x_reconnect_attempts_seen = 0;
+    return 1;
+}
+
+/* the device is open, or about to be (again): writes are queued */
+static int comport_isopen(t_comport *x)
+{
+    return x->comhandle != INVALID_HANDLE_VALUE || x->x_opening;
+}
+
+/* a pseudo-terminal as a device that needs no hardware: we use the master side,
+   whatever opens the slave side (reported as 'pty <path>') is at the other end
+   of the line. the termios settings apply to the slave as usual */
+static int comport_openpty(t_comport *x)
+{
+    int     master;
+    char    slave[MAXPDSTRING];
+    t_atom  at;
+
+    if((master = comserial_openpty(&x->x_ptyslave, slave, sizeof(slave))) == INVALID_HANDLE_VALUE)
+    {
+        pd_error(x, "[comport] ** ERROR ** could not create a pseudo-terminal: %s",
+            strerror(errno));
+        return INVALID_HANDLE_VALUE;
+    }
+    x->x_ptyname = gensym(slave);
+    comport_verbose("[comport] created pseudo-terminal %s", slave);
+    SETSYMBOL(&at, x->x_ptyname);
+    outlet_anything(x->x_status_outlet, gensym("pty"), 1, &at);
+    return master;
+}
+
+/* find the device for port #com_num (or x->serial_device) and let the worker
+   open it. opening can take seconds (e.g. for bluetooth devices), so this
+   always returns INVALID_HANDLE_VALUE: the device is installed by
+   comport_job_done() and reported with 'open 1' (or 'open 0') */
+static int open_serial(unsigned int com_num, t_comport *x)
+{
+    t_comdevices    *devices;
+    t_comjob        *j;
+
+    /* get the device path based on the port# and the glob pattern */
+    if(NULL == (devices = comdevices_get(x, x->serial_device_prefix)))
+    {
+        pd_error(x,"[comport] out of memory for \"%s\"",x->serial_device_prefix);
+        return INVALID_HANDLE_VALUE;
+    }
+    if (com_num == USE_DEVICENAME)
+    { /* if possible, find the index of the devicename */
+        int i = comdevices_find(devices, x->serial_device);
+        if (i >= 0)
+            com_num = i;
+    }
+    else if((int)com_num < devices->d_count)
+        x->serial_device = devices->d_names[com_num];
+    else
+    {
+        pd_error(x, "[comport] ** WARNING ** port #%d does not exist! (max == %d)",
+                 com_num, devices->d_count - 1);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    /* defaults, see input */
+    set_bits(x, x->data_bits);      /* CS8 */
+    set_parity(x, x->parity_bit);   /* ~PARENB */
+    set_stopflag(x, x->stop_bits);  /* ~CSTOPB */
+    set_ctsrts(x, x->ctsrts);  /* ~CRTSCTS;*/
+    set_xonxoff(x, x->xonxoff); /* (IXON | IXOFF | IXANY) */
+    set_baudrate(x, x->baud);
+
+    x->x_retry_count = 0; /* reset retry counter */
+
+    if(NULL == (j = comjob_new(x, COMPORT_JOB_OPEN)))
+        return INVALID_HANDLE_VALUE;
+    j->j_device = x->serial_device;
+    j->j_comport = com_num;
+    if(x->serial_device == gensym(COMPORT_PTY)
+        && (j->j_fd = comport_openpty(x)) == INVALID_HANDLE_VALUE)
+    {
+        free(j);
+        return INVALID_HANDLE_VALUE;
+    }
+    if(comport_submit(x, j))
+        x->x_opening = 1;
+    return INVALID_HANDLE_VALUE;
 }
 
+/* stop using the device; the worker restores the settings and closes it,
+   as closing can block until the output is drained */
 static int close_serial(t_comport *x)
 {
-    struct termios *tios = &(x->com_termio);
     HANDLE         fd = x->comhandle;
 
     if(fd != INVALID_HANDLE_VALUE)
     {
-        tcsetattr(fd, TCSANOW, tios);
-        close(fd);
-        comport_verbose("[comport] closed port %i (%s)", x->comport, x->serial_device->s_name);
+        restore_lowlatency(x, fd);
+        comport_verbose("[comport] closing port %i (%s)", x->comport, x->serial_device->s_name);
+        comport_close_fd(x, fd, &(x->x_config.c_termios));
+    }
+    if(x->x_ptyslave != INVALID_HANDLE_VALUE)
+    {
+        close(x->x_ptyslave);
+        x->x_ptyslave = INVALID_HANDLE_VALUE;
     }
     return INVALID_HANDLE_VALUE;
 }
 
+/* apply the settings in x_config to the device.
+   the worker does that in the background, errors are reported when it's done */
 static int set_serial(t_comport *x)
 {
-    if(tcsetattr(x->comhandle, TCSAFLUSH, &(x->com_termio)) == -1)
+    t_comjob *j = comjob_new(x, COMPORT_JOB_CONFIG);
+    if(NULL == j)
         return 0;
-    return 1;
+    j->j_fd = x->comhandle;
+    j->j_device = x->serial_device;
+    return comport_submit(x, j);
 }
 
 static int comport_get_dsr(t_comport *x)
 {
     short  dsr_state = 0;
 
-    if (x->comhandle != INVALID_HANDLE_VALUE)
-    {
-        int status;/*dsr outlet*/
-        /* get the DSR input state and if it's changed, output it */
-        ioctl(x->comhandle, TIOCMGET, &status);/*dsr outlet*/
-        dsr_state = ((status&TIOCM_LE)!=0);/* read the DSR input line */
-    }
+    if (x->comhandle != INVALID_HANDLE_VALUE) /* read the DSR input line */
+        dsr_state = (comserial_get_modem(x->comhandle, TIOCM_LE) > 0);
     return dsr_state;
 }
 
@@ -1097,32 +2047,1163 @@ int comport_get_cts(t_comport *x)
 {
     short  cts_state = 0;
 
-    if (x->comhandle != INVALID_HANDLE_VALUE)
+    if (x->comhandle != INVALID_HANDLE_VALUE) /* read the CTS input line */
+        cts_state = (comserial_get_modem(x->comhandle, TIOCM_CTS) > 0);
+    return cts_state;
+}
+
+/* the reader thread blocks on the device and pushes everything it gets into
+   x_rxring, so that the Pd thread never has to wait for a syscall on the device.
+   it never touches any Pd API: errors are reported via x_thread_status */
+static void *comport_reader(void *arg)
+{
+    t_comport     *x = (t_comport *)arg;
+    struct pollfd pfd[2];
+    int           status = 0;
+    int           epoch = comport_load_acquire(&x->x_stats_epoch);
+
+    pfd[0].fd = x->comhandle;
+    pfd[1].fd = x->x_wakeup[0];
+    pfd[1].events = POLLIN;
+
+    while(!comport_load_acquire(&x->x_thread_quit))
     {
-        int status;/*cts outlet*/
-        /* get the CTS input state and if it's changed, output it */
-        ioctl(x->comhandle, TIOCMGET, &status);
-        cts_state = ((status&TIOCM_CTS)!=0);/* read the CTS input line */
+        size_t        len;
+        long          n;
+
+        if(epoch != comport_load_acquire(&x->x_stats_epoch))
+        {
+            epoch = comport_load_acquire(&x->x_stats_epoch);
+            comstats_clear(&x->x_rstats);
+        }
+
+        /* if the ring is full, wait for the Pd thread to drain it */
+        comring_writeptr(&x->x_rxring, &len);
+        pfd[0].events = len ? POLLIN : 0;
+        if(poll(pfd, 2, len ? -1 : 1) < 0)
+        {
+            if(errno == EINTR) continue;
+            status = errno;
+            break;
+        }
+        if(pfd[1].revents & POLLIN)
+        {
+            char dummy[16];
+            while(read(x->x_wakeup[0], dummy, sizeof(dummy)) > 0);
+            continue;
+        }
+        if(pfd[0].revents & POLLNVAL)
+        {
+            status = EBADF;
+            break;
+        }
+        if(!len || !(pfd[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        n = comserial_read_ring(x->comhandle, &x->x_rxring, &x->x_rstats);
+        if(n > 0)
+        {
+            if(x->x_rxstamps.t_size)
+                comstamps_push(&x->x_rxstamps, x->x_rxring.r_head, comclock_now());
+            continue;
+        }
+        else if(n == 0)
+        { /* readable but nothing to read: the device is gone */
+            status = -1;
+            break;
+        }
+        else if(errno != EAGAIN && errno != EINTR)
+        {
+            status = errno;
+            break;
+        }
     }
-    return cts_state;
+    comport_store_release(&x->x_thread_status, status);
+    return 0;
 }
 
-#endif /* else NT */
+static int comport_start_thread(t_comport *x)
+{
+    if(x->x_thread_running) return 1;
+    if(x->comhandle == INVALID_HANDLE_VALUE) return 0;
 
-/* ------------------- serial pd methods --------------------------- */
-static void comport_pollintervall(t_comport *x, t_floatarg g)
+    if(NULL == x->x_rxring.r_buf
+        && !comring_init(&x->x_rxring, (size_t)x->x_rxbufsize * COMPORT_RXRING_READS))
+    {
+        pd_error(x, "[comport] unable to allocate receive ring buffer");
+        return 0;
+    }
+    if(pipe(x->x_wakeup) < 0)
+    {
+        pd_error(x, "[comport] could not create wakeup pipe: %s", strerror(errno));
+        return 0;
+    }
+    fcntl(x->x_wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(x->x_wakeup[1], F_SETFL, O_NONBLOCK);
+
+    x->x_thread_quit = 0;
+    x->x_thread_status = 0;
+    if(pthread_create(&x->x_thread, NULL, comport_reader, x) != 0)
+    {
+        pd_error(x, "[comport] could not start reader thread");
+        close(x->x_wakeup[0]);
+        close(x->x_wakeup[1]);
+        return 0;
+    }
+    x->x_thread_running = 1;
+    comport_verbose("[comport] started reader thread for %s", x->serial_device->s_name);
+    return 1;
+}
+
+static void comport_stop_thread(t_comport *x)
 {
-    if (g < 1) g = 1;
-    x->x_deltime = g;
+    ssize_t res;
+    if(!x->x_thread_running) return;
+
+    comport_store_release(&x->x_thread_quit, 1);
+    res = write(x->x_wakeup[1], "", 1);
+    (void)res;
+    pthread_join(x->x_thread, NULL);
+    close(x->x_wakeup[0]);
+    close(x->x_wakeup[1]);
+    x->x_thread_running = 0;
+    comport_verbose("[comport] stopped reader thread");
+}
+
+/* the timed queue of sendat is shared with the writer thread */
+static void comport_sendat_lock(t_comport *x)
+{
+    pthread_mutex_lock(&x->x_sendat_lock);
+}
+
+static void comport_sendat_unlock(t_comport *x)
+{
+    pthread_mutex_unlock(&x->x_sendat_lock);
+}
+
+/* ms until the first sendat payload is due, -1 if there is none */
+static double comport_sendat_wait(t_comport *x)
+{
+    double due, wait = -1;
+
+    comport_sendat_lock(x);
+    if(comsched_next(&x->x_sendat, &due))
+    {
+        wait = due - comclock_now();
+        if(wait < 0) wait = 0;
+    }
+    comport_sendat_unlock(x);
+    return wait;
+}
+
+/* write the sendat payloads that are due, returns the one the device
+   didn't take completely ('done' bytes of it are written) or NULL */
+static t_comtimed *comport_writer_timed(t_comport *x, t_comtimed *t, size_t *done)
+{
+    for(;;)
+    {
+        long n;
+        if(NULL == t)
+        {
+            double now = comclock_now();
+            comport_sendat_lock(x);
+            t = comsched_take(&x->x_sendat, now);
+            comport_sendat_unlock(x);
+            if(NULL == t) return NULL;
+            *done = 0;
+            comstats_late(&x->x_wstats, now - t->t_due);
+        }
+        n = comserial_write(x->comhandle, t->t_data + *done, t->t_len - *done, &x->x_wstats);
+        if(n < 0)
+        {
+            if(errno == EAGAIN || errno == EINTR)
+                return t;
+            comport_store_release(&x->x_writer_errors, x->x_writer_errors + 1);
+            n = t->t_len - *done; /* give up on it */
+        }
+        *done += n;
+        if(*done < t->t_len)
+            return t;
+        comtimed_free(t);
+        t = NULL;
+    }
+}
+
+/* the writer thread is the consumer of x_txring: it sleeps until the Pd
+   thread queues something, waits x_txwindow usec for more, and writes
+   everything. if the device doesn't take it all, it waits for POLLOUT.
+   it also writes the sendat payloads when they are due: poll() only
+   takes ms, so the last fraction of the wait is slept with nanosleep() */
+static void *comport_writer(void *arg)
+{
+    t_comport     *x = (t_comport *)arg;
+    struct pollfd pfd[2];
+    int           blocked = 0;
+    int           epoch = comport_load_acquire(&x->x_stats_epoch);
+    t_comtimed    *timed = NULL; /* a sendat payload the device didn't take completely */
+    size_t        timed_done = 0;
+
+    pfd[0].fd = x->x_txwakeup[0];
+    pfd[0].events = POLLIN;
+    pfd[1].fd = x->comhandle;
+    pfd[1].events = POLLOUT;
+
+    while(!comport_load_acquire(&x->x_writer_quit))
+    {
+        double wait = blocked ? -1 : comport_sendat_wait(x);
+
+        pfd[0].revents = pfd[1].revents = 0;
+        if(wait >= 0 && wait < 1)
+        {
+            struct timespec ts;
+            ts.tv_sec = 0;
+            ts.tv_nsec = (long)(wait * 1000000.);
+            nanosleep(&ts, NULL);
+        }
+        else if(poll(pfd, blocked ? 2 : 1, (wait < 0) ? -1 : (int)wait) < 0)
+        {
+            if(errno == EINTR) continue;
+            break;
+        }
+        if(pfd[0].revents & POLLIN)
+        {
+            char dummy[16];
+            int window = comport_load_acquire(&x->x_txwindow);
+            while(read(x->x_txwakeup[0], dummy, sizeof(dummy)) > 0);
+            if(comport_load_acquire(&x->x_writer_quit)) break;
+            if(window > 0 && !blocked)
+            {
+                struct timespec ts;
+                ts.tv_sec = window / 1000000;
+                ts.tv_nsec = (window % 1000000) * 1000;
+                nanosleep(&ts, NULL);
+            }
+        }
+        if(epoch != comport_load_acquire(&x->x_stats_epoch))
+        {
+            epoch = comport_load_acquire(&x->x_stats_epoch);
+            comstats_clear(&x->x_wstats);
+        }
+        /* a payload that is due goes first, but doesn't cut into a message */
+        if(NULL != timed || !blocked)
+            timed = comport_writer_timed(x, timed, &timed_done);
+        if(NULL != timed)
+            blocked = 1;
+        else if(comserial_write_ring(x->comhandle, &x->x_txring, &x->x_wstats) < 0)
+        { /* leave it to the Pd thread to tell, try again when woken up */
+            comport_store_release(&x->x_writer_errors, x->x_writer_errors + 1);
+            blocked = 0;
+        }
+        else /* whatever is left, the device didn't take */
+            blocked = comring_used(&x->x_txring) > 0;
+    }
+    if(timed)
+        comtimed_free(timed);
+    return 0;
+}
+
+static int comport_start_writer(t_comport *x)
+{
+    if(x->x_writer_running) return 1;
+    if(x->comhandle == INVALID_HANDLE_VALUE) return 0;
+
+    if(pipe(x->x_txwakeup) < 0)
+    {
+        pd_error(x, "[comport] could not create wakeup pipe: %s", strerror(errno));
+        return 0;
+    }
+    fcntl(x->x_txwakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(x->x_txwakeup[1], F_SETFL, O_NONBLOCK);
+
+    x->x_writer_quit = 0;
+    x->x_writer_errors = x->x_writer_errors_seen = 0;
+    if(pthread_create(&x->x_writer, NULL, comport_writer, x) != 0)
+    {
+        pd_error(x, "[comport] could not start writer thread");
+        close(x->x_txwakeup[0]);
+        close(x->x_txwakeup[1]);
+        return 0;
+    }
+    x->x_writer_running = 1;
+    comport_verbose("[comport] started writer thread for %s", x->serial_device->s_name);
+    comport_wake_writer(x); /* there might be something queued already */
+    return 1;
+}
+
+static void comport_stop_writer(t_comport *x)
+{
+    if(!x->x_writer_running) return;
+
+    comport_store_release(&x->x_writer_quit, 1);
+    comport_wake_writer(x);
+    pthread_join(x->x_writer, NULL);
+    close(x->x_txwakeup[0]);
+    close(x->x_txwakeup[1]);
+    x->x_writer_running = 0;
+    comport_verbose("[comport] stopped writer thread");
+}
+
+static void comport_wake_writer(t_comport *x)
+{
+    ssize_t res;
+    if(!x->x_writer_running) return;
+    res = write(x->x_txwakeup[1], "", 1);
+    (void)res;
+}
+
+/* Pd's scheduler calls this whenever the device is readable */
+static void comport_pollfn(t_comport *x, int fd)
+{
+    long n = comserial_read(fd, x->x_inbuf, x->x_inbuf_len, &x->x_stats);
+
+    if(n > 0)
+    {
+        if(x->x_timestamp)
+            x->x_rxstamp = comclock_now();
+        comport_output_bytes(x, x->x_inbuf, n);
+        return;
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    /* readable but nothing to read or a hard error: the device is gone.
+       stop polling, or we would be called over and over again */
+    if(n < 0)
+    {
+        if(x->rxerrors < 10)
+            pd_error(x, "[comport]: RXERRORS on serial line (%d)\n", errno);
+        x->rxerrors++;
+    }
+    comport_stop_pollfn(x);
+    comport_connection_lost(x);
+}
+
+static int comport_start_pollfn(t_comport *x)
+{
+    if(x->x_pollfn_registered) return 1;
+    if(x->comhandle == INVALID_HANDLE_VALUE) return 0;
+
+    sys_addpollfn(x->comhandle, (t_fdpollfn)comport_pollfn, x);
+    x->x_pollfn_registered = 1;
+    return 1;
+}
+
+static void comport_stop_pollfn(t_comport *x)
+{
+    if(!x->x_pollfn_registered) return;
+
+    sys_rmpollfn(x->comhandle);
+    x->x_pollfn_registered = 0;
+}
+
+/* iomode shared: one engine thread reads all devices into their x_rxring
+   and Pd's fd polling calls us (once for all of them) when there's news */
+static void comport_shared_pollfn(void *dummy, int fd)
+{
+    t_comsource *s;
+    (void)dummy;
+    (void)fd;
+
+    while((s = comengine_next()))
+    {
+        t_comport *x = (t_comport *)s->s_owner;
+        int       status = comport_load_acquire(&s->s_status);
+
+        comport_drain_rxring(x);
+        if(x->comhandle == INVALID_HANDLE_VALUE || !x->x_shared) continue; /* closed from downstream */
+        if(status != 0)
+        { /* the engine has given up on the device */
+            comport_stop_shared(x);
+            comport_drain_rxring(x);
+            if(status > 0 && x->rxerrors < 10)
+                pd_error(x, "[comport]: RXERRORS on serial line (%d)\n", status);
+            if(status > 0) x->rxerrors++;
+            if(x->comhandle == INVALID_HANDLE_VALUE) continue;
+            comport_connection_lost(x);
+            continue;
+        }
+        comengine_resume(s);
+    }
+}
+
+static int comport_start_shared(t_comport *x)
+{
+    if(x->x_shared) return 1;
+    if(x->comhandle == INVALID_HANDLE_VALUE) return 0;
+
+    if(NULL == x->x_rxring.r_buf
+        && !comring_init(&x->x_rxring, (size_t)x->x_rxbufsize * COMPORT_RXRING_READS))
+    {
+        pd_error(x, "[comport] unable to allocate receive ring buffer");
+        return 0;
+    }
+    x->x_source.s_fd = x->comhandle;
+    x->x_source.s_ring = &x->x_rxring;
+    x->x_source.s_stats = &x->x_rstats;
+    x->x_source.s_epoch = &x->x_stats_epoch;
+    x->x_source.s_owner = x;
+    x->x_source.s_stamps = x->x_rxstamps.t_size ? &x->x_rxstamps : NULL;
+    if(!comengine_add(&x->x_source))
+    {
+        pd_error(x, "[comport] could not add %s to the I/O engine: %s",
+            x->serial_device->s_name, strerror(errno));
+        return 0;
+    }
+    if(comengine_count() == 1) /* the first one */
+        sys_addpollfn(comengine_fd(), (t_fdpollfn)comport_shared_pollfn, NULL);
+    x->x_shared = 1;
+    comport_verbose("[comport] %s is read by the I/O engine (%d ports)",
+        x->serial_device->s_name, comengine_count());
+    return 1;
+}
+
+static void comport_stop_shared(t_comport *x)
+{
+    if(!x->x_shared) return;
+
+    if(comengine_count() == 1) /* the last one, the engine goes away */
+        sys_rmpollfn(comengine_fd());
+    comengine_remove(&x->x_source);
+    x->x_shared = 0;
+}
+
+#endif /* else NT */
+
+/* start/stop whatever the current iomode needs to receive from an open device */
+static void comport_start_io(t_comport *x)
+{
+    switch(x->x_iomode)
+    {
+        case COMPORT_IOMODE_THREAD:
+            comport_start_thread(x);
+            break;
+        case COMPORT_IOMODE_EVENT:
+            comport_start_pollfn(x);
+            break;
+        case COMPORT_IOMODE_SHARED:
+            comport_start_shared(x);
+            break;
+        default:
+            break;
+    }
+    if(x->x_txmode == COMPORT_TXMODE_THREAD)
+        comport_start_writer(x);
+    comport_sendat_arm(x);
+}
+
+static void comport_stop_io(t_comport *x)
+{
+    comport_stop_thread(x);
+    comport_stop_pollfn(x);
+    comport_stop_shared(x);
+    comport_stop_writer(x);
+    clock_unset(x->x_txclock);
+    clock_unset(x->x_sendat_clock);
+}
+
+/* ------------------- serial pd methods --------------------------- */
+static void comport_pollintervall(t_comport *x, t_floatarg g)
+{
+    if (g < 1) g = 1;
+    x->x_deltime = g;
+}
+
+static void comport_retries(t_comport *x, t_floatarg g)
+{
+    if (g < 0) g = 0;
+    x->x_retries = g;
+}
+
+static void comport_iomode(t_comport *x, t_symbol *s)
+{
+    int mode;
+
+    if(s == gensym("poll"))
+        mode = COMPORT_IOMODE_POLL;
+    else if(s == gensym("thread"))
+        mode = COMPORT_IOMODE_THREAD;
+    else if(s == gensym("event"))
+        mode = COMPORT_IOMODE_EVENT;
+    else if(s == gensym("shared"))
+        mode = COMPORT_IOMODE_SHARED;
+    else
+    {
+        pd_error(x, "[comport] unknown iomode '%s' (use 'poll', 'thread', 'event' or 'shared')", s->s_name);
+        return;
+    }
+#ifdef _WIN32
+    if(mode != COMPORT_IOMODE_POLL)
+    {
+        pd_error(x, "[comport] iomode '%s' is not supported on Windows", s->s_name);
+        return;
+    }
+#endif
+    if(mode == x->x_iomode) return;
+
+    /* anything left in the ring goes out with the next tick */
+    comport_stop_io(x);
+    x->x_iomode = mode;
+    comport_start_io(x);
+    if(x->comhandle != INVALID_HANDLE_VALUE)
+        clock_delay(x->x_clock, x->x_deltime);
+    comport_verbose("[comport] iomode is %s", s->s_name);
+}
+
+/* output the performance counters, or reset them with 'stats reset' */
+static void comport_stats(t_comport *x, t_symbol *s)
+{
+    t_comstats *st[3];
+    unsigned long rxbytes = 0, txbytes = 0, reads = 0, writes = 0, maxread = 0;
+    unsigned long timed = 0;
+    long latesum = 0, latemin = 0, latemax = 0;
+    int i, nsets = 3;
+
+    if(s == gensym("reset"))
+    {
+        comstats_clear(&x->x_stats);
+        /* the threads clear their own counters when they see this */
+        comport_store_release(&x->x_stats_epoch, x->x_stats_epoch + 1);
+#ifndef _WIN32
+        if(x->x_thread_running)
+        {
+            ssize_t res = write(x->x_wakeup[1], "", 1);
+            (void)res;
+        }
+        comport_wake_writer(x);
+#endif
+        x->x_dataticks = x->x_emptyticks = 0;
+        x->x_txdropped = 0;
+        x->x_rxring_max = x->x_txqueue_max = 0;
+        x->x_ticktime = x->x_tickmax = 0;
+        x->x_unpack_errors = 0;
+        x->x_check_errors = 0;
+        return;
+    }
+    if(s != &s_)
+    {
+        pd_error(x, "[comport] stats: unknown argument '%s' (use 'reset')", s->s_name);
+        return;
+    }
+    st[0] = &x->x_stats;
+    st[1] = &x->x_wstats;
+    st[2] = &x->x_rstats;
+#ifndef _WIN32
+    /* the I/O engine only clears them with its next read */
+    if(x->x_shared && comport_load_acquire(&x->x_source.s_seen_epoch) != x->x_stats_epoch)
+        nsets = 2;
+#endif
+    for(i = 0; i < nsets; i++)
+    {
+        unsigned long n = comport_load_acquire(&st[i]->s_maxread);
+        rxbytes += comport_load_acquire(&st[i]->s_rxbytes);
+        txbytes += comport_load_acquire(&st[i]->s_txbytes);
+        reads += comport_load_acquire(&st[i]->s_reads);
+        writes += comport_load_acquire(&st[i]->s_writes);
+        if(n > maxread) maxread = n;
+        n = comport_load_acquire(&st[i]->s_timed);
+        if(n > 0)
+        {
+            long lmin = comport_load_acquire(&st[i]->s_latemin);
+            long lmax = comport_load_acquire(&st[i]->s_latemax);
+            if(0 == timed || lmin < latemin) latemin = lmin;
+            if(0 == timed || lmax > latemax) latemax = lmax;
+            latesum += comport_load_acquire(&st[i]->s_latesum);
+            timed += n;
+        }
+    }
+    comport_output_status(x, gensym("rxbytes"), rxbytes);
+    comport_output_status(x, gensym("txbytes"), txbytes);
+    comport_output_status(x, gensym("reads"), reads);
+    comport_output_status(x, gensym("writes"), writes);
+    comport_output_status(x, gensym("maxread"), maxread);
+    comport_output_status(x, gensym("dataticks"), x->x_dataticks);
+    comport_output_status(x, gensym("emptyticks"), x->x_emptyticks);
+    comport_output_status(x, gensym("ticktime"), x->x_ticktime);
+    comport_output_status(x, gensym("tickmax"), x->x_tickmax);
+    comport_output_status(x, gensym("txdropped"), x->x_txdropped);
+    comport_output_status(x, gensym("rxringmax"), x->x_rxring_max);
+    comport_output_status(x, gensym("txqueuemax"), x->x_txqueue_max);
+    comport_output_status(x, gensym("rxerrors"), x->rxerrors);
+    comport_output_status(x, gensym("txerrors"), x->txerrors);
+    comport_output_status(x, gensym("unpackerrors"), x->x_unpack_errors);
+    comport_output_status(x, gensym("checksumerrors"), x->x_check_errors);
+    /* how late the sendat payloads were written, in ms (negative: early) */
+    comport_output_status(x, gensym("sendat"), timed);
+    comport_output_status(x, gensym("latemean"), timed ? latesum * 0.001 / timed : 0);
+    comport_output_status(x, gensym("latemin"), latemin * 0.001);
+    comport_output_status(x, gensym("latemax"), latemax * 0.001);
+}
+
+static void comport_txmode(t_comport *x, t_symbol *s)
+{
+    int mode;
+
+    if(s == gensym("tick"))
+        mode = COMPORT_TXMODE_TICK;
+    else if(s == gensym("immediate"))
+        mode = COMPORT_TXMODE_IMMEDIATE;
+    else if(s == gensym("thread"))
+        mode = COMPORT_TXMODE_THREAD;
+    else
+    {
+        pd_error(x, "[comport] unknown txmode '%s' (use 'tick', 'immediate' or 'thread')", s->s_name);
+        return;
+    }
+#ifdef _WIN32
+    if(mode == COMPORT_TXMODE_THREAD)
+    {
+        pd_error(x, "[comport] txmode '%s' is not supported on Windows", s->s_name);
+        return;
+    }
+#endif
+    if(mode == x->x_txmode) return;
+
+    comport_stop_writer(x);
+    clock_unset(x->x_txclock);
+    x->x_txmode = mode;
+    if(x->comhandle != INVALID_HANDLE_VALUE)
+    {
+        if(mode == COMPORT_TXMODE_THREAD)
+            comport_start_writer(x);
+        else /* whatever is queued goes out with the next tick */
+            clock_delay(x->x_clock, 0);
+        comport_sendat_arm(x);
+    }
+    comport_verbose("[comport] txmode is %s", s->s_name);
+}
+
+static void comport_set_txwindow(t_comport *x, t_floatarg f)
+{
+    if(f < 0) f = 0;
+    if(f > 1000000) f = 1000000;
+    comport_store_release(&x->x_txwindow, (int)f);
+    comport_verbose("[comport] txwindow is %d usec", x->x_txwindow);
+}
+
+/* make sure the atom buffer can hold the longest list we might output.
+   a message from downstream of the data outlet (blockmode, frame, framemax,
+   unpack) may ask for this while a list from it is still being output, then
+   it waits for comport_output_done() */
+static int comport_alloc_atombuf(t_comport *x)
+{
+    int len = 0;
+
+    if(x->x_outputting)
+    {
+        x->x_atombuf_stale = 1;
+        return 1;
+    }
+
+    if(x->x_blockmode)
+        len = x->x_blocksize ? x->x_blocksize : x->x_rxbufsize;
+    if(x->x_framer.f_type != COMPORT_FRAME_NONE && x->x_framer.f_max > len)
+        len = x->x_framer.f_max;
+    if(x->x_unpack && x->x_unpack_nvalues > len)
+        len = x->x_unpack_nvalues;
+    if(len == x->x_atombuf_len) return 1;
+
+    if(x->x_atombuf)
+        freebytes(x->x_atombuf, x->x_atombuf_len * sizeof(t_atom));
+    x->x_atombuf = len ? getbytes(len * sizeof(t_atom)) : NULL;
+    x->x_atombuf_len = x->x_atombuf ? len : 0;
+    if(len && NULL == x->x_atombuf)
+    {
+        pd_error(x, "[comport] unable to allocate list buffer");
+        return 0;
+    }
+    return 1;
+}
+
+static void comport_blockmode(t_comport *x, t_floatarg f, t_floatarg size)
+{
+    x->x_blockmode = (f != 0);
+    x->x_blocksize = (size > 0) ? (int)size : 0;
+    if(!comport_alloc_atombuf(x))
+        x->x_blockmode = 0;
+    comport_verbose("[comport] blockmode is %s (max. %d bytes per list)",
+        x->x_blockmode?"on":"off", x->x_blocksize ? x->x_blocksize : x->x_rxbufsize);
+}
+
+static void comport_frame(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_comframer *f = &x->x_framer;
+    t_symbol    *type = atom_getsymbolarg(0, argc, argv);
+    int         i, max = f->f_max ? f->f_max : COMPORT_FRAMEMAX;
+    (void)s; /* squelch unused-parameter warning */
+
+    argc--;
+    argv++;
+    if(type == gensym("off"))
+    {
+        f->f_type = COMPORT_FRAME_NONE;
+        comframer_free(f);
+        f->f_max = max; /* remember for when framing gets turned on again */
+        comport_alloc_atombuf(x);
+        comport_verbose("[comport] framing is off");
+        return;
+    }
+    else if(type == gensym("delimiter"))
+    {
+        if(argc < 1 || argc > COMPORT_MAXDELIM)
+        {
+            pd_error(x, "[comport] frame delimiter needs 1 to %d bytes", COMPORT_MAXDELIM);
+            return;
+        }
+        for(i = 0; i < argc; i++)
+            f->f_delim[i] = atom_getint(argv + i) & 0xFF;
+        f->f_delim_len = argc;
+        if(max < argc) max = argc;
+        f->f_type = COMPORT_FRAME_DELIMITER;
+    }
+    else if(type == gensym("markers"))
+    {
+        if(argc != 2)
+        {
+            pd_error(x, "[comport] usage: frame markers <start> <end>");
+            return;
+        }
+        f->f_delim[0] = atom_getint(argv) & 0xFF;
+        f->f_delim[1] = atom_getint(argv + 1) & 0xFF;
+        f->f_delim_len = 2;
+        f->f_type = COMPORT_FRAME_MARKERS;
+    }
+    else if(type == gensym("fixed"))
+    {
+        int n = atom_getintarg(0, argc, argv);
+        if(n < 1)
+        {
+            pd_error(x, "[comport] usage: frame fixed <size>");
+            return;
+        }
+        f->f_fixed = n;
+        if(max < n) max = n;
+        f->f_type = COMPORT_FRAME_FIXED;
+    }
+    else if(type == gensym("slip"))
+        f->f_type = COMPORT_FRAME_SLIP;
+    else if(type == gensym("cobs"))
+        f->f_type = COMPORT_FRAME_COBS;
+    else if(type == gensym("hdlc"))
+        f->f_type = COMPORT_FRAME_HDLC;
+    else if(type == gensym("length"))
+    {
+        int offset = atom_getintarg(0, argc, argv);
+        int size = atom_getintarg(1, argc, argv);
+        t_symbol *order = atom_getsymbolarg(3, argc, argv);
+        if(offset < 0 || (size != 1 && size != 2 && size != 4)
+            || (argc > 3 && order != gensym("little") && order != gensym("big")))
+        {
+            pd_error(x, "[comport] usage: frame length <offset> <1|2|4> [<adjust> [little|big]]");
+            return;
+        }
+        f->f_len_offset = offset;
+        f->f_len_size = size;
+        f->f_len_adjust = atom_getintarg(2, argc, argv);
+        f->f_len_bigendian = (order == gensym("big"));
+        if(max < offset + size) max = offset + size;
+        f->f_type = COMPORT_FRAME_LENGTH;
+    }
+    else
+    {
+        pd_error(x, "[comport] unknown framing '%s' (use off, delimiter, markers, fixed, length, slip, cobs or hdlc)",
+            type->s_name);
+        return;
+    }
+    if(!comframer_setmax(f, max) || !comport_alloc_atombuf(x))
+    {
+        pd_error(x, "[comport] unable to allocate frame buffer");
+        f->f_type = COMPORT_FRAME_NONE;
+        comport_alloc_atombuf(x);
+        return;
+    }
+    comport_verbose("[comport] framing is %s (max. %d bytes)", type->s_name, f->f_max);
+}
+
+static void comport_framemax(t_comport *x, t_floatarg fmax)
+{
+    t_comframer *f = &x->x_framer;
+    int         max = (int)fmax, min = 1;
+
+    if(COMPORT_FRAME_DELIMITER == f->f_type) min = f->f_delim_len;
+    if(COMPORT_FRAME_FIXED == f->f_type) min = f->f_fixed;
+    if(COMPORT_FRAME_LENGTH == f->f_type) min = f->f_len_offset + f->f_len_size;
+    if(max < min)
+    {
+        pd_error(x, "[comport] framemax %d too small for current framing, using %d", max, min);
+        max = min;
+    }
+    if(COMPORT_FRAME_NONE == f->f_type)
+    { /* remember for when framing gets turned on */
+        f->f_max = max;
+        return;
+    }
+    if(!comframer_setmax(f, max) || !comport_alloc_atombuf(x))
+    {
+        pd_error(x, "[comport] unable to allocate frame buffer");
+        f->f_type = COMPORT_FRAME_NONE;
+        comport_alloc_atombuf(x);
+    }
+}
+
+/* the decoders are just framers that unstuff on the fly */
+static void comport_decode(t_comport *x, t_symbol *s)
+{
+    t_atom type;
+    if(s != gensym("off") && s != gensym("slip") && s != gensym("cobs") && s != gensym("hdlc"))
+    {
+        pd_error(x, "[comport] unknown decoder '%s' (use off, slip, cobs or hdlc)", s->s_name);
+        return;
+    }
+    SETSYMBOL(&type, s);
+    comport_frame(x, gensym("frame"), 1, &type);
+}
+
+/* the atoms are joined, so that "unpack < 3h f" works as well as "unpack <3hf" */
+static void comport_unpack(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+    char        fmt[MAXPDSTRING];
+    t_comformat m;
+    t_comfield  f, *fields;
+    int         i, len = 0, size, nfields, nvalues;
+    (void)s; /* squelch unused-parameter warning */
+
+    fmt[0] = 0;
+    for(i = 0; i < argc && len < MAXPDSTRING - 1; i++)
+    {
+        if(i) fmt[len++] = ' ';
+        atom_string(argv + i, fmt + len, MAXPDSTRING - len);
+        len += strlen(fmt + len);
+    }
+    if(!argc || !strcmp(fmt, "off"))
+    {
+        if(x->x_unpack)
+            freebytes(x->x_unpack, x->x_unpack_nfields * sizeof(t_comfield));
+        x->x_unpack = NULL;
+        x->x_unpack_nfields = x->x_unpack_size = x->x_unpack_nvalues = 0;
+        comport_alloc_atombuf(x);
+        comport_verbose("[comport] unpack is off");
+        return;
+    }
+    if(!comformat_measure(fmt, &size, &nfields, &nvalues) || !nfields)
+    {
+        comformat_init(&m, fmt);
+        while(comformat_next(&m, &f) > 0)
+            ;
+        pd_error(x, "[comport] unpack: bad format '%s' at '%s'", fmt, *m.m_next ? m.m_next : "end");
+        return;
+    }
+    fields = getbytes(nfields * sizeof(t_comfield));
+    if(NULL == fields)
+    {
+        pd_error(x, "[comport] unable to allocate unpack format");
+        return;
+    }
+    comformat_init(&m, fmt);
+    for(i = 0; i < nfields; i++)
+        comformat_next(&m, fields + i);
+    if(x->x_unpack)
+        freebytes(x->x_unpack, x->x_unpack_nfields * sizeof(t_comfield));
+    x->x_unpack = fields;
+    x->x_unpack_nfields = nfields;
+    x->x_unpack_size = size;
+    x->x_unpack_nvalues = nvalues;
+    if(!comport_alloc_atombuf(x))
+    {
+        comport_unpack(x, gensym("unpack"), 0, 0);
+        return;
+    }
+    if(COMPORT_FRAME_NONE == x->x_framer.f_type)
+        comport_verbose("[comport] unpack applies to frames, e.g. 'frame fixed %d'", size);
+    comport_verbose("[comport] unpack %s: %d bytes, %d values per record", fmt, size, nvalues);
+}
+
+static void comport_checksum(t_comport *x, t_symbol *s, t_floatarg skip)
+{
+    const t_comcheck *check = NULL;
+
+    if(s != gensym("off") && NULL == (check = comcheck_find(s->s_name)))
+    {
+        pd_error(x, "[comport] unknown checksum '%s' (use off, %s)", s->s_name, comcheck_names());
+        return;
+    }
+    x->x_check = check;
+    x->x_check_skip = (skip > 0) ? (int)skip : 0;
+    if(check && COMPORT_FRAME_NONE == x->x_framer.f_type)
+        comport_verbose("[comport] checksums are verified on frames, see 'frame'");
+    comport_verbose("[comport] checksum is %s (%d bytes skipped)", s->s_name, x->x_check_skip);
+}
+
+static void comport_encode(t_comport *x, t_symbol *s)
+{
+    if(s == gensym("off"))
+        x->x_encoder = COMPORT_FRAME_NONE;
+    else if(s == gensym("slip"))
+        x->x_encoder = COMPORT_FRAME_SLIP;
+    else if(s == gensym("cobs"))
+        x->x_encoder = COMPORT_FRAME_COBS;
+    else if(s == gensym("hdlc"))
+        x->x_encoder = COMPORT_FRAME_HDLC;
+    else
+    {
+        pd_error(x, "[comport] unknown encoder '%s' (use off, slip, cobs or hdlc)", s->s_name);
+        return;
+    }
+    comport_verbose("[comport] encoder is %s", s->s_name);
+}
+
+static void comport_timestamp(t_comport *x, t_floatarg f)
+{
+    t_bool on = (f != 0);
+
+    if(on == x->x_timestamp) return;
+    /* the reader threads note when they read, they must not see this change */
+    comport_stop_io(x);
+    if(on && !comstamps_init(&x->x_rxstamps, COMPORT_STAMPS))
+    {
+        pd_error(x, "[comport] unable to allocate timestamps");
+        on = 0;
+    }
+    if(!on)
+        comstamps_free(&x->x_rxstamps);
+    x->x_timestamp = on;
+    x->x_ts_synced = 0;
+    comport_start_io(x);
+    comport_verbose("[comport] timestamps are %s", on ? "on" : "off");
+}
+
+static void comport_txwatermarks(t_comport *x, t_floatarg high, t_floatarg low)
+{
+    int size = x->x_txbufsize;
+    if(high < 1 || high > size || low < 0 || low >= high)
+    {
+        pd_error(x, "[comport] txwatermarks: need 0 <= low < high <= %d", size);
+        return;
+    }
+    x->x_txhigh = high;
+    x->x_txlow = low;
+    comport_txwatermark(x);
+}
+
+/* where Pd's logical time is on the monotonic clock. the scheduler runs late
+   by varying amounts, so the offset follows the least lateness seen (and may
+   creep up by 200 ppm for drift between the clocks), the error is the
+   average lateness beyond that */
+static void comport_timestamp_sync(t_comport *x)
+{
+    double now = comclock_now();
+    double lateness = now - clock_gettimesince(0);
+
+    if(x->x_ts_synced <= 0)
+    {
+        x->x_ts_offset = lateness;
+        x->x_ts_error = 0;
+    }
+    else
+    {
+        double creep = x->x_ts_offset + (now - x->x_ts_synced) * 0.0002;
+        x->x_ts_offset = (lateness < creep) ? lateness : creep;
+        x->x_ts_error += ((lateness - x->x_ts_offset) - x->x_ts_error) * 0.1;
+    }
+    x->x_ts_synced = now;
+}
+
+/* 'timestamp <ms> <error>' before each chunk or frame: when its last byte
+   was read, in ms of logical time from now (so mostly negative) */
+static void comport_output_timestamp(t_comport *x)
+{
+    t_atom at[2];
+
+    if(!x->x_timestamp) return;
+    comport_timestamp_sync(x);
+    SETFLOAT(at, (x->x_rxstamp - x->x_ts_offset) - clock_gettimesince(0));
+    SETFLOAT(at + 1, x->x_ts_error);
+    outlet_anything(x->x_status_outlet, gensym("timestamp"), 2, at);
+}
+
+/* the atom buffer isn't in use anymore, resize it if that was asked for */
+static void comport_output_done(t_comport *x)
+{
+    if(--x->x_outputting > 0 || !x->x_atombuf_stale) return;
+    x->x_atombuf_stale = 0;
+    if(!comport_alloc_atombuf(x))
+        x->x_blockmode = 0;
+}
+
+/* output a list of bytes via the atom buffer */
+static void comport_output_list(t_comport *x, const unsigned char *buf, int len)
+{
+    t_atom *ap = x->x_atombuf;
+    int    i;
+
+    if(len > x->x_atombuf_len) len = x->x_atombuf_len;
+    for (i = 0; i < len; ++i)
+        SETFLOAT(ap + i, (t_float) buf[i]);
+    x->x_outputting++;
+    outlet_list(x->x_data_outlet, &s_list, len, ap);
+    comport_output_done(x);
+}
+
+/* decode the records in a frame with the 'unpack' format, one list each */
+static void comport_output_records(t_comport *x, const unsigned char *buf, int len)
+{
+    t_atom *ap = x->x_atombuf;
+    int    size = x->x_unpack_size;
+
+    if(len < size || len % size || x->x_unpack_nvalues > x->x_atombuf_len)
+    {
+        x->x_unpack_errors++;
+        return;
+    }
+    x->x_outputting++;
+    for(; len > 0; len -= size)
+    {
+        int i, j, n = 0;
+        for(i = 0; i < x->x_unpack_nfields; i++)
+        {
+            const t_comfield   *f = x->x_unpack + i;
+            int                nvalues = comfield_nvalues(f);
+            unsigned long long raw = nvalues ? comfield_load(f, buf) : 0;
+            for(j = 0; j < nvalues; j++, n++)
+                SETFLOAT(ap + n, comfield_value(f, raw, j));
+            buf += f->f_size;
+        }
+        outlet_list(x->x_data_outlet, &s_list, n, ap);
+        /* the outlet might have changed the format or the framing (and with
+           it the frame we are reading from) */
+        if(size != x->x_unpack_size || NULL == x->x_unpack || x->x_atombuf_stale) break;
+    }
+    comport_output_done(x);
+}
+
+static void comport_output_frame(void *owner, const unsigned char *frame, int len)
+{
+    t_comport *x = (t_comport *)owner;
+    if(x->x_check)
+    { /* drop bad frames, strip the checksum from good ones */
+        if(len < x->x_check_skip || !comcheck_verify(x->x_check,
+            frame + x->x_check_skip, len - x->x_check_skip))
+        {
+            x->x_check_errors++;
+            return;
+        }
+        len -= comcheck_size(x->x_check);
+    }
+    comport_output_timestamp(x);
+    if(x->x_unpack)
+        comport_output_records(x, frame, len);
+    else
+        comport_output_list(x, frame, len);
+}
+
+/* send received bytes out of the data outlet: either as frames,
+   one float per byte or (in blockmode) as lists */
+static void comport_output_bytes(t_comport *x, const unsigned char *buf, int len)
+{
+    int i;
+
+    x->x_tick_hasdata = 1;
+    if(x->x_rxarray)
+    {
+        comport_record(x, buf, len);
+        return;
+    }
+    if(x->x_framer.f_type != COMPORT_FRAME_NONE)
+    {
+        comframer_push(&x->x_framer, buf, len, comport_output_frame, x);
+        return;
+    }
+    if(x->x_blockmode)
+    {
+        int blocksize = x->x_blocksize ? x->x_blocksize : x->x_atombuf_len;
+        while(len > 0 && blocksize > 0)
+        {
+            int n = (len > blocksize) ? blocksize : len;
+            comport_output_timestamp(x);
+            comport_output_list(x, buf, n);
+            buf += n;
+            len -= n;
+        }
+        return;
+    }
+    comport_output_timestamp(x);
+    for (i = 0; i < len; ++i)
+        outlet_float(x->x_data_outlet, (t_float) buf[i]);
+}
+
+/* output whatever the reader thread has put into the receive ring,
+   but no more than it held when we started (the reader keeps on filling it) */
+static void comport_drain_rxring(t_comport *x)
+{
+    size_t budget = x->x_rxring.r_size;
+
+    if(x->x_rxring.r_buf && comring_used(&x->x_rxring) > x->x_rxring_max)
+        x->x_rxring_max = comring_used(&x->x_rxring);
+    while(budget > 0 && x->x_rxring.r_buf)
+    {
+        size_t               len;
+        const unsigned char  *buf = comring_readptr(&x->x_rxring, &len);
+
+        if(0 == len) break;
+        if(len > budget) len = budget;
+        if(len > (size_t)x->x_inbuf_len) len = x->x_inbuf_len;
+        if(x->x_timestamp)
+        { /* one read at a time, with its own timestamp */
+            size_t end;
+            if(comstamps_find(&x->x_rxstamps, x->x_rxring.r_tail, &x->x_rxstamp, &end))
+            {
+                if(end - x->x_rxring.r_tail < len)
+                    len = end - x->x_rxring.r_tail;
+            }
+            else
+                x->x_rxstamp = comclock_now();
+        }
+        /* copy out first, the outlet might lead to a close or a mode change */
+        memcpy(x->x_inbuf, buf, len);
+        comring_consume(&x->x_rxring, len);
+        budget -= len;
+        comport_output_bytes(x, x->x_inbuf, (int)len);
+    }
 }
 
-static void comport_retries(t_comport *x, t_floatarg g)
+/* called when the device has vanished.
+   returns 1 if we keep on trying, 0 if we gave up and closed the port */
+static int comport_connection_lost(t_comport *x)
 {
-    if (g < 0) g = 0;
-    x->x_retries = g;
+#ifndef _WIN32
+    if(x->x_reconnect && x->x_identity)
+    { /* close the dead device but keep everything else, including the TX queue */
+        pd_error(x, "[comport]: lost connection to port %i (%s), waiting for %s...",
+                 x->comport, x->serial_device->s_name, x->x_identity->s_name);
+        comport_stop_io(x);
+        x->comhandle = close_serial(x);
+        comport_output_open_status(x);
+        if(comport_reconnect_start(x))
+        {
+            comport_output_status(x, gensym("reconnecting"), 0);
+            return 0;
+        }
+        comport_close(x);
+        return 0;
+    }
+#endif
+    if(x->x_retry_count < x->x_retries)
+    {
+        t_atom retrying_atom;
+        SETFLOAT(&retrying_atom, x->x_retry_count);
+        outlet_anything(x->x_status_outlet, gensym("retrying"), 1, &retrying_atom);
+
+        pd_error(x, "[comport]: lost connection to port %i (%s), retrying...",
+                 x->comport, x->serial_device->s_name);
+        if (!x->x_hit)
+            clock_delay(x->x_clock, 1000); /* retry every second */
+        x->x_retry_count++;
+        return 1;
+    }
+    pd_error(x, "[comport]: Giving up on port %i (%s)!",
+             x->comport, x->serial_device->s_name);
+    comport_close(x);
+    return 0;
 }
 
-static void comport_tick(t_comport *x)
+static void comport_dotick(t_comport *x)
 {
 #ifdef _WIN32
     HANDLE       fd = x->comhandle;
@@ -1133,12 +3214,25 @@ static void comport_tick(t_comport *x)
 
     x->x_hit = 0;
 
+#ifndef _WIN32
+    if(x->x_jobs)
+    { /* the worker is busy with the device */
+        comport_jobs_poll(x);
+        if(x->comhandle == INVALID_HANDLE_VALUE)
+        {
+            if(x->x_jobs)
+                clock_delay(x->x_clock, x->x_deltime);
+            return;
+        }
+        fd = x->comhandle;
+    }
+#endif
+
     if(fd != INVALID_HANDLE_VALUE)
     { /* while there are bytes, read them and send them out, ignore errors (!??) */
 #ifdef _WIN32
         DWORD           dwRead;
         OVERLAPPED      osReader;
-        DWORD           dwX;
         DWORD           whicherr = 0;
 
         err = 0;
@@ -1154,12 +3248,12 @@ static void comport_tick(t_comport *x)
         if(ReadFile(x->comhandle, x->x_inbuf, x->x_inbuf_len, &dwRead, &osReader))
         //if (ReadFile(x->comhandle, x->x_inbuf, NULL, &dwRead, &osReader))
         {
+            comstats_read(&x->x_stats, dwRead);
             if(dwRead > 0)
             {
-                for(dwX = 0; dwX < dwRead ;dwX++)
-                {
-                    outlet_float(x->x_data_outlet, (t_float) x->x_inbuf[dwX]);
-                }
+                if(x->x_timestamp)
+                    x->x_rxstamp = comclock_now();
+                comport_output_bytes(x, x->x_inbuf, dwRead);
             }
         }
         else
@@ -1171,12 +3265,12 @@ static void comport_tick(t_comport *x)
                 if (GetOverlappedResult(x->comhandle, &osReader, &dwRead, FALSE)) // don't wait
                 {
                     //post("dwRead %ld\n", dwRead);
+                    comstats_read(&x->x_stats, dwRead);
                     if (dwRead > 0)
                     {
-                        for (dwX = 0; dwX < dwRead;dwX++)
-                        {
-                            outlet_float(x->x_data_outlet, (t_float)x->x_inbuf[dwX]);
-                        }
+                        if (x->x_timestamp)
+                            x->x_rxstamp = comclock_now();
+                        comport_output_bytes(x, x->x_inbuf, dwRead);
                     }
                 }
                 else
@@ -1191,53 +3285,68 @@ static void comport_tick(t_comport *x)
 #else
         fd_set          com_rfds;
         int             count = 0;
-        int             i;
         long int        whicherr = 0;
 
-        FD_ZERO(&com_rfds);
-        FD_SET(fd,&com_rfds);
-        while((err = select(fd+1, &com_rfds, NULL, NULL, &null_tv)) > 0)
+        err = 0;
+        /* anything left over from (or delivered by) the reader thread */
+        comport_drain_rxring(x);
+        if(x->comhandle == INVALID_HANDLE_VALUE) return; /* closed from downstream */
+
+        if(x->x_iomode == COMPORT_IOMODE_EVENT)
+        { /* reading happens in comport_pollfn(), we are only here for writing
+             (or to retry after a lost connection) */
+            comport_start_pollfn(x);
+        }
+        else if(x->x_iomode == COMPORT_IOMODE_SHARED)
+        { /* same here, with comport_shared_pollfn() */
+            comport_start_shared(x);
+        }
+        else if(x->x_iomode == COMPORT_IOMODE_THREAD)
+        {
+            int status = comport_load_acquire(&x->x_thread_status);
+            if(status != 0)
+            { /* the reader has terminated */
+                comport_stop_thread(x);
+                comport_drain_rxring(x);
+                if(status > 0 && x->rxerrors < 10)
+                    pd_error(x, "[comport]: RXERRORS on serial line (%d)\n", status);
+                if(status > 0) x->rxerrors++;
+                if(x->comhandle == INVALID_HANDLE_VALUE) return;
+                if(comport_connection_lost(x))
+                    comport_start_thread(x);
+                return;
+            }
+        }
+        else
         {
-            ioctl(fd, FIONREAD, &count); /* load count with the number of bytes in the receive buffer... */
-            if (count > x->x_inbuf_len) count = x->x_inbuf_len; /* ...but no more than the buffer can hold */
-            /*err = read(fd,(char *) &serial_byte,1);*/
-            err = read(fd,(char *)x->x_inbuf, count);/* try to read count bytes */
-            if (err > 0)
+            FD_ZERO(&com_rfds);
+            FD_SET(fd,&com_rfds);
+            while((err = select(fd+1, &com_rfds, NULL, NULL, &null_tv)) > 0)
             {
-                for (i = 0; i < err; ++i )
+                ioctl(fd, FIONREAD, &count); /* load count with the number of bytes in the receive buffer... */
+                if (count > x->x_inbuf_len) count = x->x_inbuf_len; /* ...but no more than the buffer can hold */
+                /*err = read(fd,(char *) &serial_byte,1);*/
+                err = comserial_read(fd, x->x_inbuf, count, &x->x_stats);/* try to read count bytes */
+                if (err > 0)
                 {
-                    outlet_float(x->x_data_outlet, (t_float) x->x_inbuf[i]);
+                    if (x->x_timestamp)
+                        x->x_rxstamp = comclock_now();
+                    comport_output_bytes(x, x->x_inbuf, err);
+                    if(x->comhandle == INVALID_HANDLE_VALUE) return; /* closed from downstream */
                 }
-            }
-            else if (err == 0 && count == 0)
-            {
-                /* if both ioctl() and read() return a 0 count, assume
-                 * that we lost the connection to the serial port.
-                 * otherwise there is a race condition when the serial
-                 * port gets interrupted, like if the USB gets yanked
-                 * out or a bluetooth connection drops */
-                if(x->x_retry_count < x->x_retries)
+                else if (err == 0 && count == 0)
                 {
-                    t_atom retrying_atom;
-                    SETFLOAT(&retrying_atom, x->x_retry_count);
-                    outlet_anything(x->x_status_outlet, gensym("retrying"), 1, &retrying_atom);
-
-                    pd_error(x, "[comport]: lost connection to port %i (%s), retrying...",
-                             x->comport, x->serial_device->s_name);
-                    if (!x->x_hit)
-                        clock_delay(x->x_clock, 1000); /* retry every second */
-                    x->x_retry_count++;
+                    /* if both ioctl() and read() return a 0 count, assume
+                     * that we lost the connection to the serial port.
+                     * otherwise there is a race condition when the serial
+                     * port gets interrupted, like if the USB gets yanked
+                     * out or a bluetooth connection drops */
+                    comport_connection_lost(x);
                     return;
                 }
                 else
-                {
-                    pd_error(x, "[comport]: Giving up on port %i (%s)!",
-                             x->comport, x->serial_device->s_name);
-                    comport_close(x);
-                }
+                    whicherr = errno;
             }
-            else
-                whicherr = errno;
         }
 #endif /* _WIN32 */
         if(err < 0)
@@ -1246,126 +3355,858 @@ static void comport_tick(t_comport *x)
                 pd_error(x, "[comport]: RXERRORS on serial line (%ld)\n", (long int)whicherr);
             x->rxerrors++; /* remember */
         }
-/* now if anything to send, send the output buffer */
-        if (0 != x->x_outbuf_wr_index)
+/* now if anything to send, send the output queue */
+        comport_txarray_fill(x);
+        if (x->x_txmode != COMPORT_TXMODE_THREAD)
+            comport_txflush(x);
+#ifndef _WIN32
+        else
+        { /* the writer thread does the work, we do the talking */
+            int errors = comport_load_acquire(&x->x_writer_errors);
+            if (errors != x->x_writer_errors_seen)
+            {
+                if (x->txerrors < 10)
+                    pd_error(x, "[comport]: Write failed (%d times)", errors - x->x_writer_errors_seen);
+                x->txerrors += errors - x->x_writer_errors_seen;
+                x->x_writer_errors_seen = errors;
+            }
+            if (x->x_txbackpressure)
+                comport_txwatermark(x);
+        }
+#endif
+        /* in event and shared mode, idle ports don't need the clock: writes re-arm it */
+        if (!x->x_hit && ((x->x_iomode != COMPORT_IOMODE_EVENT && x->x_iomode != COMPORT_IOMODE_SHARED)
+            || comring_used(&x->x_txring)
+            || x->x_txarray_n
+#ifndef _WIN32
+            || x->x_jobs
+#endif
+            ))
+            clock_delay(x->x_clock, x->x_deltime); /* default 10 ms */
+    }
+}
+
+/* outgoing bytes are staged behind the queued data and only become visible
+   to the sender with comport_txcommit(), so that a message (or frame) is
+   either queued completely or not at all */
+static int comport_txput(t_comport *x, unsigned char c)
+{
+    if(x->x_txscratch)
+    {
+        if(x->x_txstaged >= x->x_txscratch_size)
+            return 0;
+        x->x_txscratch[x->x_txstaged] = c;
+    }
+    else if(!comring_stage(&x->x_txring, x->x_txstaged, c))
+        return 0;
+    x->x_txstaged++;
+    return 1;
+}
+
+/* overwrite a byte staged earlier */
+static void comport_txpatch(t_comport *x, size_t offset, unsigned char c)
+{
+    if(x->x_txscratch)
+        x->x_txscratch[offset] = c;
+    else
+        comring_patch(&x->x_txring, offset, c);
+}
+
+/* check the queue fill against the watermarks */
+static void comport_txwatermark(t_comport *x)
+{
+    size_t used = comring_used(&x->x_txring);
+    if(!x->x_txbackpressure && used >= (size_t)x->x_txhigh)
+    {
+        x->x_txbackpressure = 1;
+        comport_output_status(x, gensym("txbackpressure"), 1);
+    }
+    else if(x->x_txbackpressure && used <= (size_t)x->x_txlow)
+    {
+        x->x_txbackpressure = 0;
+        comport_output_status(x, gensym("txbackpressure"), 0);
+    }
+}
+
+/* in event and shared mode the clock only runs while there is something to write */
+static void comport_txarm(t_comport *x)
+{
+    if((x->x_iomode == COMPORT_IOMODE_EVENT || x->x_iomode == COMPORT_IOMODE_SHARED) && !x->x_hit)
+        clock_delay(x->x_clock, x->x_deltime);
+}
+
+static void comport_txcommit(t_comport *x)
+{
+    size_t committed = x->x_txstaged;
+    int    was_empty;
+    if(0 == committed) return;
+    comring_produce(&x->x_txring, committed);
+    x->x_txstaged = 0;
+    /* checked after publishing, so the writer thread can't miss the wakeup */
+    was_empty = comring_used(&x->x_txring) <= committed;
+    if(comring_used(&x->x_txring) > x->x_txqueue_max)
+        x->x_txqueue_max = comring_used(&x->x_txring);
+    comport_txwatermark(x);
+    switch(x->x_txmode)
+    {
+        case COMPORT_TXMODE_IMMEDIATE:
+            if(x->x_txwindow > 0)
+            { /* coalesce whatever comes in during the window */
+                if(was_empty)
+                    clock_delay(x->x_txclock, x->x_txwindow * 0.001);
+                break;
+            }
+            comport_txflush(x);
+            if(comring_used(&x->x_txring)) /* the rest goes out with the next tick */
+                comport_txarm(x);
+            break;
+        case COMPORT_TXMODE_THREAD:
+            if(was_empty)
+                comport_wake_writer(x);
+            if(x->x_txbackpressure) /* to see it drain */
+                comport_txarm(x);
+            break;
+        default:
+            if(was_empty)
+                comport_txarm(x);
+            break;
+    }
+}
+
+/* end of the coalescing window in immediate mode */
+static void comport_txtick(t_comport *x)
+{
+    if(x->comhandle == INVALID_HANDLE_VALUE) return;
+    comport_txflush(x);
+    if(comring_used(&x->x_txring))
+        comport_txarm(x);
+}
+
+static void comport_txdiscard(t_comport *x)
+{
+    x->x_txdropped += x->x_txstaged;
+    x->x_txstaged = 0;
+}
+
+/* when there's no writer thread to wait for the first sendat payload,
+   a clock does it: on Pd's logical timeline, mapped like the timestamps */
+static void comport_sendat_arm(t_comport *x)
+{
+    double due, delay;
+    int    pending;
+
+    comport_sendat_lock(x);
+    pending = comsched_next(&x->x_sendat, &due);
+    comport_sendat_unlock(x);
+    clock_unset(x->x_sendat_clock);
+    if(!pending || x->comhandle == INVALID_HANDLE_VALUE) return;
+#ifndef _WIN32
+    if(x->x_writer_running)
+    {
+        comport_wake_writer(x);
+        return;
+    }
+#endif
+    comport_timestamp_sync(x);
+    delay = (due - x->x_ts_offset) - clock_gettimesince(0);
+    clock_delay(x->x_sendat_clock, (delay > 0) ? delay : 0);
+}
+
+/* queue the payloads that are due behind what is queued already, and write them */
+static void comport_sendat_tick(t_comport *x)
+{
+    t_comtimed *t;
+    double     now;
+
+    if(x->comhandle == INVALID_HANDLE_VALUE) return;
+#ifndef _WIN32
+    if(x->x_writer_running)
+    {
+        comport_sendat_arm(x);
+        return;
+    }
+#endif
+    comport_timestamp_sync(x);
+    now = clock_gettimesince(0) + x->x_ts_offset;
+    for(;;)
+    {
+        size_t i;
+        comport_sendat_lock(x);
+        t = comsched_take(&x->x_sendat, now);
+        comport_sendat_unlock(x);
+        if(NULL == t) break;
+        for(i = 0; i < t->t_len; i++)
+            if(!comport_txput(x, t->t_data[i]))
+                break;
+        if(i < t->t_len)
+        {
+            comport_txdiscard(x);
+            pd_error(x, "[comport]: buffer is full, sendat payload dropped");
+        }
+        else
         {
+            comstats_late(&x->x_stats, comclock_now() - t->t_due);
+            comport_txcommit(x);
+        }
+        comtimed_free(t);
+    }
+    comport_txflush(x);
+    if(comring_used(&x->x_txring))
+        comport_txarm(x);
+    comport_sendat_arm(x);
+}
+
+/* write as much of the queue as the device takes, keep the rest for the next tick */
+static void comport_txflush(t_comport *x)
+{
+    size_t len;
+#ifdef _WIN32
+    const unsigned char *buf;
+#else
+    long n;
+#endif
+    if(x->comhandle == INVALID_HANDLE_VALUE) return; /* keep it for when the device is back */
 #ifdef _WIN32
-            OVERLAPPED osWrite;
-            DWORD      dwWritten;
-            DWORD      dwToWrite = (DWORD)x->x_outbuf_wr_index;
-            DWORD      dwErr;
-            DWORD      numTransferred = 0L;
+    while((buf = comring_readptr(&x->x_txring, &len)), len > 0)
+    {
+        OVERLAPPED osWrite;
+        DWORD      dwWritten;
+        DWORD      dwToWrite = (DWORD)len;
+        DWORD      dwErr;
+        DWORD      numTransferred = 0L;
 
 /* initialize all fields off osWrite to zero to avoid gcc warnings about */
 /* missing initializer if we just do osWrite ={0} */
-            osWrite.hEvent = 0;
-            osWrite.Internal = 0;
-            osWrite.InternalHigh = 0;
-            osWrite.Offset = 0;
-            osWrite.OffsetHigh = 0;
-            /*osWrite.Pointer = 0; seems MinGW doesn't know about this one */
-            osWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-            if (osWrite.hEvent == NULL)
+        osWrite.hEvent = 0;
+        osWrite.Internal = 0;
+        osWrite.InternalHigh = 0;
+        osWrite.Offset = 0;
+        osWrite.OffsetHigh = 0;
+        /*osWrite.Pointer = 0; seems MinGW doesn't know about this one */
+        osWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (osWrite.hEvent == NULL)
+        {
+            pd_error(x, "[comport]: Couldn't create event. Transmission aborted.");
+            break;
+        }
+        if (!WriteFile(x->comhandle, buf, dwToWrite, &dwWritten, &osWrite))
+        {
+            dwErr = GetLastError();
+            if (dwErr != ERROR_IO_PENDING)
+            {
+                if(x->txerrors++ < 10)
+                    pd_error(x, "[comport]: WriteFile error: %d", (int)dwErr);
+                CloseHandle(osWrite.hEvent);
+                break;
+            }
+        }
+        if (!GetOverlappedResult(x->comhandle, &osWrite, &numTransferred, TRUE))
+        {/* wait for the character(s) to be sent */
+            dwErr = GetLastError();
+            if(x->txerrors++ < 10)
+                pd_error(x, "[comport]: WriteFile:GetOverlappedResult error: %d", (int)dwErr);
+        }
+        CloseHandle(osWrite.hEvent);
+        comstats_write(&x->x_stats, numTransferred);
+        if (numTransferred > 0) x->x_tick_hasdata = 1;
+        comring_consume(&x->x_txring, numTransferred);
+        if (numTransferred < dwToWrite) break; /* keep the rest */
+    }
+#else
+    /* whatever the driver doesn't take is kept for the next tick */
+    len = comring_used(&x->x_txring);
+    n = comserial_write_ring(x->comhandle, &x->x_txring, &x->x_stats);
+    if (n > 0)
+        x->x_tick_hasdata = 1;
+    else if (n < 0 && x->txerrors++ < 10) /* ten times max */
+        pd_error(x, "[comport]: Write failed for %lu bytes, error is %d",
+            (unsigned long)len, errno);
+#endif /* _WIN32 */
+    if (x->x_txbackpressure)
+        comport_txwatermark(x);
+}
+
+/* comport_dotick() with some bookkeeping */
+static void comport_tick(t_comport *x)
+{
+    double start = sys_getrealtime();
+    double elapsed;
+
+    x->x_tick_hasdata = 0;
+    comport_dotick(x);
+    if (x->x_tick_hasdata)
+        x->x_dataticks++;
+    else
+        x->x_emptyticks++;
+    elapsed = (sys_getrealtime() - start) * 1000.;
+    x->x_ticktime += elapsed;
+    if (elapsed > x->x_tickmax)
+        x->x_tickmax = elapsed;
+}
+
+static int write_serial(t_comport *x, unsigned char  serial_byte)
+{
+    if(!comport_isopen(x))
+    {
+        comport_verbose ("[comport]: Serial port is not open");
+        return 0;
+    }
+    else if(comport_txput(x, serial_byte))
+    {
+        comport_txcommit(x);
+        return 1;
+    }
+    /* handle overrun error */
+    x->x_txdropped++;
+    pd_error (x, "[comport]: buffer is full");
+    return 0;
+}
+
+/* with an encoder, every message is sent as one frame that is stuffed
+   straight into the TX queue. a frame that does not fit is dropped as a whole */
+static void comport_txframe_raw(t_comport *x, unsigned char c)
+{
+    if(!comport_txput(x, c))
+    {
+        x->x_txframe_overflow = 1;
+        x->x_txdropped++;
+    }
+}
+
+static void comport_txframe_begin(t_comport *x)
+{
+    x->x_txframe_overflow = 0;
+    if(x->x_check)
+    {
+        x->x_txcheck = comcheck_start(x->x_check);
+        x->x_txcheck_len = 0;
+    }
+    switch(x->x_encoder)
+    {
+        case COMPORT_FRAME_SLIP:
+            comport_txframe_raw(x, SLIP_END); /* flush any line noise */
+            break;
+        case COMPORT_FRAME_HDLC:
+            comport_txframe_raw(x, HDLC_FLAG);
+            break;
+        case COMPORT_FRAME_COBS:
+            x->x_txframe_code = x->x_txstaged;
+            comport_txframe_raw(x, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+/* COBS: fill in the code byte of the current block and start the next one */
+static void comport_txframe_cobs_block(t_comport *x, int last)
+{
+    if(!x->x_txframe_overflow)
+        comport_txpatch(x, x->x_txframe_code,
+            x->x_txstaged - x->x_txframe_code);
+    if(last) return;
+    x->x_txframe_code = x->x_txstaged;
+    comport_txframe_raw(x, 0);
+}
+
+/* put a byte of the message, stuffed as the encoder wants it */
+static void comport_txframe_stuff(t_comport *x, unsigned char c)
+{
+    switch(x->x_encoder)
+    {
+        case COMPORT_FRAME_SLIP:
+            if(SLIP_END == c)
+            {
+                comport_txframe_raw(x, SLIP_ESC);
+                c = SLIP_ESC_END;
+            }
+            else if(SLIP_ESC == c)
+            {
+                comport_txframe_raw(x, SLIP_ESC);
+                c = SLIP_ESC_ESC;
+            }
+            break;
+        case COMPORT_FRAME_HDLC:
+            /* and the control characters, as with PPP's default ACCM */
+            if(HDLC_FLAG == c || HDLC_ESC == c || c < 0x20)
+            {
+                comport_txframe_raw(x, HDLC_ESC);
+                c ^= HDLC_XOR;
+            }
+            break;
+        case COMPORT_FRAME_COBS:
+            if(0 == c)
+                comport_txframe_cobs_block(x, 0);
+            else
             {
-                pd_error(x, "[comport]: Couldn't create event. Transmission aborted.");
-                goto endsendevent;
+                comport_txframe_raw(x, c);
+                if(x->x_txstaged - x->x_txframe_code == 0xFF)
+                    comport_txframe_cobs_block(x, 0);
             }
+            return;
+        default:
+            break;
+    }
+    comport_txframe_raw(x, c);
+}
+
+static void comport_txframe_put(t_comport *x, unsigned char c)
+{
+    if(x->x_check && x->x_txcheck_len++ >= x->x_check_skip)
+        x->x_txcheck = comcheck_update(x->x_check, x->x_txcheck, &c, 1);
+    comport_txframe_stuff(x, c);
+}
+
+/* the end of the frame stays staged, 0 if it didn't fit */
+static int comport_txframe_finish(t_comport *x)
+{
+    if(x->x_check)
+    {
+        unsigned char sum[4];
+        int           i;
+        comcheck_finish(x->x_check, x->x_txcheck, sum);
+        for(i = 0; i < comcheck_size(x->x_check); i++)
+            comport_txframe_stuff(x, sum[i]);
+    }
+    switch(x->x_encoder)
+    {
+        case COMPORT_FRAME_SLIP:
+            comport_txframe_raw(x, SLIP_END);
+            break;
+        case COMPORT_FRAME_HDLC:
+            comport_txframe_raw(x, HDLC_FLAG);
+            break;
+        case COMPORT_FRAME_COBS:
+            comport_txframe_cobs_block(x, 1);
+            comport_txframe_raw(x, 0);
+            break;
+        default:
+            break;
+    }
+    if(x->x_txframe_overflow)
+    {
+        comport_txdiscard(x);
+        pd_error(x, "[comport]: buffer is full, message dropped");
+        return 0;
+    }
+    return 1;
+}
+
+static int comport_txframe_end(t_comport *x)
+{
+    if(!comport_txframe_finish(x))
+        return 0;
+    comport_txcommit(x);
+    return 1;
+}
+
+static void comport_float(t_comport *x, t_float f)
+{
+    unsigned char serial_byte = ((int) f) & 0xFF; /* brutal conv */
+
+    if(comport_txbusy(x)) return;
+    if((x->x_encoder != COMPORT_FRAME_NONE || x->x_check) && comport_isopen(x))
+    {
+        comport_txframe_begin(x);
+        comport_txframe_put(x, serial_byte);
+        comport_txframe_end(x);
+        return;
+    }
+    if (write_serial(x,serial_byte) != 1)
+    {
+        pd_error(x, "Write error, maybe TX-OVERRUNS on serial line");
+    }
+}
+
+static void comport_list(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i;
+    (void)s; /* squelch unused-parameter warning */
+
+    if(!comport_isopen(x))
+    {
+        pd_error (x, "[comport]: Serial port is not open");
+        return;
+    }
+    if(comport_txbusy(x)) return;
+    /* staged straight into the queue, as one frame if there's an encoder */
+    comport_txframe_begin(x);
+    for(i = 0; i < argc; i++)
+        comport_txframe_put(x, ((unsigned char)atom_getint(argv+i))&0xFF); /* brutal conv */
+    comport_txframe_end(x);
+}
+
+/* "sendat <ms> <bytes...>": send the bytes (as one message, like a list)
+   that many ms of logical time from now. they are encoded right away and
+   wait in a queue of their own: with the writer thread (txmode thread) they
+   are written when the monotonic clock gets there, otherwise when Pd's
+   clock does */
+static void comport_sendat(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+    double        delay;
+    unsigned char *buf;
+    size_t        size, len;
+    int           i, ok;
+    (void)s; /* squelch unused-parameter warning */
+
+    if(argc < 2 || argv->a_type != A_FLOAT)
+    {
+        pd_error(x, "[comport] usage: sendat <ms> <bytes...>");
+        return;
+    }
+    if(!comport_isopen(x))
+    {
+        pd_error (x, "[comport]: Serial port is not open");
+        return;
+    }
+    delay = atom_getfloat(argv);
+    if(delay < 0) delay = 0;
+    /* worst case: every byte of the message and checksum escaped,
+       plus the delimiters */
+    size = 2 * ((size_t)(argc - 1) + 4) + 4;
+    if(NULL == (buf = (unsigned char *)getbytes(size)))
+    {
+        pd_error(x, "[comport] unable to allocate %lu bytes for sendat",
+            (unsigned long)size);
+        return;
+    }
+    /* staged like any message, but into buf rather than the TX queue */
+    x->x_txscratch = buf;
+    x->x_txscratch_size = size;
+    comport_txframe_begin(x);
+    for(i = 1; i < argc; i++)
+        comport_txframe_put(x, ((unsigned char)atom_getint(argv+i))&0xFF); /* brutal conv */
+    ok = comport_txframe_finish(x);
+    len = x->x_txstaged;
+    x->x_txstaged = 0;
+    x->x_txscratch = NULL;
+    x->x_txscratch_size = 0;
+    if(ok)
+    {
+        comport_timestamp_sync(x);
+        comport_sendat_lock(x);
+        ok = (x->x_sendat.s_bytes + len <= (size_t)x->x_txbufsize)
+            && comsched_add(&x->x_sendat, (clock_gettimesince(0) + delay) + x->x_ts_offset, buf, len);
+        comport_sendat_unlock(x);
+        if(!ok)
+        {
+            x->x_txdropped += len;
+            pd_error(x, "[comport]: sendat queue is full, message dropped");
+        }
+    }
+    freebytes(buf, size);
+    if(ok)
+        comport_sendat_arm(x);
+}
+
+/* serialize the values with a record format (see libcomport.h), field by
+   field straight into the queue: "pack <hf 1000 0.5" */
+static void comport_pack(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_comformat m;
+    t_comfield  f;
+    int         res, i = 1;
+    (void)s; /* squelch unused-parameter warning */
 
-            else if (!WriteFile(x->comhandle, x->x_outbuf, dwToWrite, &dwWritten, &osWrite))
-            {
-                dwErr = GetLastError();
-                if (dwErr != ERROR_IO_PENDING)
-                {
-                    pd_error(x, "[comport]: WriteFile error: %d", (int)dwErr);
-                    goto endsendevent;
-                }
-            }
-            if (!GetOverlappedResult(x->comhandle, &osWrite, &numTransferred, TRUE))
-            {/* wait for the character(s) to be sent */
-                dwErr = GetLastError();
-                pd_error(x, "[comport]: WriteFile:GetOverlappedResult error: %d", (int)dwErr);
-            }
-endsendevent:
-            CloseHandle(osWrite.hEvent);
-#else
-            err = write(x->comhandle,(char *)x->x_outbuf, x->x_outbuf_wr_index);
-            if (err != x->x_outbuf_wr_index)
-            {
-                pd_error(x,"[comport]: Write failed for %d bytes, error is %d",err,errno);
-            }
-#endif /*_WIN32*/
-            x->x_outbuf_wr_index = 0; /* for now we just drop anything that didn't send */
+    if(argc < 1 || argv->a_type != A_SYMBOL)
+    {
+        pd_error(x, "[comport] usage: pack <format> <values...>");
+        return;
+    }
+    if(!comport_isopen(x))
+    {
+        pd_error (x, "[comport]: Serial port is not open");
+        return;
+    }
+    if(comport_txbusy(x)) return;
+    comformat_init(&m, atom_getsymbol(argv)->s_name);
+    comport_txframe_begin(x);
+    while((res = comformat_next(&m, &f)) > 0)
+    {
+        unsigned char      bytes[8];
+        unsigned long long raw = 0;
+        int                j, nvalues = comfield_nvalues(&f);
+
+        for(j = 0; j < nvalues; j++, i++)
+        {
+            if(i >= argc || argv[i].a_type != A_FLOAT)
+                break;
+            raw = comfield_setvalue(&f, raw, j, atom_getfloat(argv + i));
         }
-        if (!x->x_hit) clock_delay(x->x_clock, x->x_deltime); /* default 10 ms */
+        if(j < nvalues)
+            break;
+        comfield_store(&f, raw, bytes);
+        for(j = 0; j < f.f_size; j++)
+            comport_txframe_put(x, bytes[j]);
+    }
+    if(res != 0 || i != argc)
+    {
+        x->x_txstaged = 0; /* unstage what was packed so far */
+        if(res < 0)
+            pd_error(x, "[comport] pack: bad format '%s' at '%s'",
+                atom_getsymbol(argv)->s_name, *m.m_next ? m.m_next : "end");
+        else if(i >= argc)
+            pd_error(x, "[comport] pack: not enough values for '%s'",
+                atom_getsymbol(argv)->s_name);
+        else
+            pd_error(x, "[comport] pack: value %d is extra or not a number for '%s'",
+                i, atom_getsymbol(argv)->s_name);
+        return;
     }
+    comport_txframe_end(x);
 }
 
-static int write_serial(t_comport *x, unsigned char  serial_byte)
+/* the sample formats of writearray, by name or as a record format with one value */
+static int comport_sampleformat(t_symbol *s, t_comfield *f)
 {
-    if(x->comhandle == INVALID_HANDLE_VALUE)
+    static const char *names[][2] = {
+        {"u8", "B"}, {"s8", "b"},
+        {"u16", "<H"}, {"s16", "<h"}, {"u32", "<I"}, {"s32", "<i"}, {"f32", "<f"},
+        {"u16be", ">H"}, {"s16be", ">h"}, {"u32be", ">I"}, {"s32be", ">i"}, {"f32be", ">f"}
+    };
+    const char  *fmt = s->s_name;
+    t_comformat m;
+    t_comfield  rest;
+    unsigned    i;
+
+    for(i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if(!strcmp(fmt, names[i][0]))
+            fmt = names[i][1];
+    comformat_init(&m, fmt);
+    return comformat_next(&m, f) > 0 && comfield_nvalues(f) == 1
+        && comformat_next(&m, &rest) == 0;
+}
+
+/* queue as much of the pending writearray as fits */
+static void comport_txarray_fill(t_comport *x)
+{
+    const t_comfield *f = &x->x_txarray_field;
+    t_garray         *a;
+    t_word           *vec;
+    int              size;
+    size_t           space;
+
+    if(!x->x_txarray_n) return;
+    a = (t_garray *)pd_findbyclass(x->x_txarray, garray_class);
+    if(!a || !garray_getfloatwords(a, &size, &vec))
     {
-        comport_verbose ("[comport]: Serial port is not open");
-        return 0;
+        pd_error(x, "[comport] writearray: %s: no such array", x->x_txarray->s_name);
+        x->x_txarray_n = 0;
+        return;
     }
-    else if(x->x_outbuf_wr_index < x->x_outbuf_len)
+    if(x->x_txarray_pos + x->x_txarray_n > size) /* it has been resized meanwhile */
+        x->x_txarray_n = (size > x->x_txarray_pos) ? size - x->x_txarray_pos : 0;
+    space = x->x_txring.r_size - comring_used(&x->x_txring) - x->x_txstaged;
+    for(; x->x_txarray_n > 0 && space >= (size_t)f->f_size; space -= f->f_size)
     {
-        x->x_outbuf[x->x_outbuf_wr_index++] = serial_byte;
-        return 1;
+        unsigned char bytes[8];
+        int           i;
+        comfield_store(f, comfield_setvalue(f, 0, 0, vec[x->x_txarray_pos++].w_float), bytes);
+        for(i = 0; i < f->f_size; i++)
+            comport_txput(x, bytes[i]);
+        x->x_txarray_n--;
     }
-    /* handle overrun error */
-    pd_error (x, "[comport]: buffer is full");
-    return 0;
+    comport_txcommit(x);
+    if(!x->x_txarray_n)
+        comport_output_status(x, gensym("writearray"), x->x_txarray_total);
 }
 
-static int write_serials(t_comport *x, unsigned char *serial_buf, int buf_length)
+/* messages can't overtake a writearray that is still being queued */
+static int comport_txbusy(t_comport *x)
 {
-    int i;
-    if(x->comhandle == INVALID_HANDLE_VALUE)
+    if(!x->x_txarray_n) return 0;
+    comport_txarray_fill(x);
+    if(!x->x_txarray_n) return 0;
+    pd_error(x, "[comport]: writearray still in progress, message dropped");
+    return 1;
+}
+
+/* convert samples straight from the array into the queue. without an
+   encoder or checksum, arrays of any size are streamed as the queue drains,
+   otherwise they are sent as one frame that has to fit into it */
+static void comport_writearray(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol   *name = atom_getsymbolarg(0, argc, argv), *format = gensym("u8");
+    t_comfield f;
+    t_garray   *a;
+    t_word     *vec;
+    int        i, size, onset = 0, n = -1, nfloats = 0;
+    (void)s; /* squelch unused-parameter warning */
+
+    if(argc < 1 || argv->a_type != A_SYMBOL)
+    {
+        pd_error(x, "[comport] usage: writearray <name> [<onset> [<n>]] [<format>]");
+        return;
+    }
+    for(i = 1; i < argc; i++)
+    {
+        if(argv[i].a_type == A_SYMBOL)
+            format = atom_getsymbol(argv + i);
+        else if(nfloats++ == 0)
+            onset = atom_getint(argv + i);
+        else
+            n = atom_getint(argv + i);
+    }
+    if(!comport_sampleformat(format, &f))
+    {
+        pd_error(x, "[comport] writearray: unknown sample format '%s' (use u8, s8, u16, s16, u32, s32, f32, "
+            "the same with 'be' for big endian, or a record format like '>h')", format->s_name);
+        return;
+    }
+    if(!comport_isopen(x))
     {
         pd_error (x, "[comport]: Serial port is not open");
-        return 0;
+        return;
+    }
+    if(comport_txbusy(x)) return;
+    a = (t_garray *)pd_findbyclass(name, garray_class);
+    if(!a || !garray_getfloatwords(a, &size, &vec))
+    {
+        pd_error(x, "[comport] writearray: %s: no such array", name->s_name);
+        return;
+    }
+    if(onset < 0) onset = 0;
+    if(onset > size) onset = size;
+    if(n < 0 || n > size - onset) n = size - onset;
+    if(x->x_encoder != COMPORT_FRAME_NONE || x->x_check)
+    {
+        comport_txframe_begin(x);
+        for(i = onset; i < onset + n && !x->x_txframe_overflow; i++)
+        {
+            unsigned char bytes[8];
+            int           j;
+            comfield_store(&f, comfield_setvalue(&f, 0, 0, vec[i].w_float), bytes);
+            for(j = 0; j < f.f_size; j++)
+                comport_txframe_put(x, bytes[j]);
+        }
+        if(comport_txframe_end(x))
+            comport_output_status(x, gensym("writearray"), n);
+        return;
     }
-    for (i = 0; ((i < buf_length) && (x->x_outbuf_wr_index < x->x_outbuf_len)); ++x->x_outbuf_wr_index, ++i)
-        x->x_outbuf[x->x_outbuf_wr_index] = serial_buf[i];
-    if (i != buf_length) pd_error (x, "[comport]: buffer is full");
-    return i;
+    x->x_txarray = name;
+    x->x_txarray_field = f;
+    x->x_txarray_pos = onset;
+    x->x_txarray_n = x->x_txarray_total = n;
+    if(n)
+        comport_txarray_fill(x);
+    else
+        comport_output_status(x, gensym("writearray"), 0);
 }
 
-static void comport_float(t_comport *x, t_float f)
+/* decode received samples into the array, wrapping around at its end */
+static void comport_record(t_comport *x, const unsigned char *buf, int len)
 {
-    unsigned char serial_byte = ((int) f) & 0xFF; /* brutal conv */
+    const t_comfield *f = &x->x_rxarray_field;
+    t_garray         *a = (t_garray *)pd_findbyclass(x->x_rxarray, garray_class);
+    t_word           *vec;
+    int              size;
 
-    if (write_serial(x,serial_byte) != 1)
+    if(!a || !garray_getfloatwords(a, &size, &vec) || size < 1)
     {
-        pd_error(x, "Write error, maybe TX-OVERRUNS on serial line");
+        pd_error(x, "[comport] recordarray: %s: no such array, recording stopped", x->x_rxarray->s_name);
+        x->x_rxarray = NULL;
+        return;
+    }
+    if(x->x_rxarray_pos >= size) /* it has been resized meanwhile */
+        x->x_rxarray_pos = 0;
+    while(len > 0)
+    {
+        const unsigned char *sample = buf;
+        if(x->x_rxarray_fill || len < f->f_size)
+        { /* a sample that is split between two reads */
+            while(len > 0 && x->x_rxarray_fill < f->f_size)
+            {
+                x->x_rxarray_partial[x->x_rxarray_fill++] = *buf++;
+                len--;
+            }
+            if(x->x_rxarray_fill < f->f_size)
+                break;
+            x->x_rxarray_fill = 0;
+            sample = x->x_rxarray_partial;
+        }
+        else
+        {
+            buf += f->f_size;
+            len -= f->f_size;
+        }
+        vec[x->x_rxarray_pos].w_float = comfield_value(f, comfield_load(f, sample), 0);
+        if(++x->x_rxarray_pos >= size)
+            x->x_rxarray_pos = 0;
+    }
+    /* redraw (and report where we are) at most every x_rxarray_redraw ms */
+    if(!x->x_rxarray_dirty)
+    {
+        double wait = x->x_rxarray_redraw - clock_gettimesince(x->x_rxarray_drawn);
+        x->x_rxarray_dirty = 1;
+        clock_delay(x->x_rxarray_clock, wait > 0 ? wait : 0);
     }
 }
 
-static void comport_list(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+static void comport_record_redraw(t_comport *x)
+{
+    t_garray *a;
+
+    x->x_rxarray_dirty = 0;
+    x->x_rxarray_drawn = clock_getlogicaltime();
+    if(!x->x_rxarray) return;
+    if((a = (t_garray *)pd_findbyclass(x->x_rxarray, garray_class)))
+        garray_redraw(a);
+    comport_output_status(x, gensym("recordarray"), x->x_rxarray_pos);
+}
+
+/* received data goes into the array instead of the outlet */
+static void comport_recordarray(t_comport *x, t_symbol *s, int argc, t_atom *argv)
 {
-    unsigned char   temp_array[COMPORT_BUF_SIZE];/* arbitrary maximum list length */
-    int             i, count;
+    t_symbol   *name = atom_getsymbolarg(0, argc, argv), *format = gensym("u8");
+    t_comfield f;
+    int        i;
     (void)s; /* squelch unused-parameter warning */
 
-    count = argc;
-    if (argc > COMPORT_BUF_SIZE)
+    if(argc < 1 || argv->a_type != A_SYMBOL)
     {
-        pd_error (x, "[comport] truncated list of %d elements to %d", argc, count);
-        count = COMPORT_BUF_SIZE;
+        pd_error(x, "[comport] usage: recordarray <name> [<format>] [<redraw ms>] or recordarray off");
+        return;
     }
-    for(i = 0; i < count; i++)
-        temp_array[i] = ((unsigned char)atom_getint(argv+i))&0xFF; /* brutal conv */
-    write_serials(x, temp_array, count);
+    if(name == gensym("off"))
+    {
+        if(x->x_rxarray && x->x_rxarray_dirty)
+        {
+            clock_unset(x->x_rxarray_clock);
+            comport_record_redraw(x);
+        }
+        x->x_rxarray = NULL;
+        comport_verbose("[comport] recordarray is off");
+        return;
+    }
+    for(i = 1; i < argc; i++)
+    {
+        if(argv[i].a_type == A_SYMBOL)
+            format = atom_getsymbol(argv + i);
+        else
+            x->x_rxarray_redraw = (atom_getfloat(argv + i) > 0) ? atom_getfloat(argv + i) : 0;
+    }
+    if(!comport_sampleformat(format, &f))
+    {
+        pd_error(x, "[comport] recordarray: unknown sample format '%s' (use u8, s8, u16, s16, u32, s32, f32, "
+            "the same with 'be' for big endian, or a record format like '>h')", format->s_name);
+        return;
+    }
+    if(!pd_findbyclass(name, garray_class))
+        pd_error(x, "[comport] recordarray: %s: no such array (yet)", name->s_name);
+    x->x_rxarray = name;
+    x->x_rxarray_field = f;
+    x->x_rxarray_pos = x->x_rxarray_fill = 0;
+    comport_verbose("[comport] recording %s samples into %s, redrawn every %g ms",
+        format->s_name, name->s_name, x->x_rxarray_redraw);
 }
 
 static void *comport_new(t_symbol *s, int argc, t_atom *argv)
 {
-    t_comport test;
     t_comport *x;
-    HANDLE    fd;
     const char *serial_device_prefix;
     int com_num = 0;
     int ibaud = 9600;
+    int rxbufsize = COMPORT_BUF_SIZE, txbufsize = COMPORT_BUF_SIZE;
     (void)s; /* squelch unused-parameter warning */
 
 #ifdef _WIN32
@@ -1392,88 +4233,62 @@ allows COM port numbers to be specified. */
     }
     if(argc > 1)
         ibaud = atom_getfloatarg(1, argc, argv);
-
-/*	 Open the Comport for RD and WR and get a handle */
-/* this line should use a real serial device */
-#ifdef _WIN32
-    strncpy_s(test.serial_device_prefix, strlen(serial_device_prefix) + 1, serial_device_prefix, strlen(serial_device_prefix) + 1);
-#else
-    strncpy(test.serial_device_prefix, serial_device_prefix, MAXPDSTRING-1);
-    test.serial_device_prefix[MAXPDSTRING-1] = 0;
-#endif
-    test.baud = ibaud;
-    test.data_bits = 8; /* default 8 data bits */
-    test.parity_bit = 0;/* default no parity bit */
-#ifdef _WIN32
-    test.stop_bits = 1;/* default 1 stop bit */
-#else
-    test.stop_bits = 0;/* default 1 stop bit */
-#endif /* _WIN32 */
-    test.ctsrts = 0; /* default no hardware handshaking */
-    test.xonxoff = 0; /* default no software handshaking */
-    test.hupcl = 1; /* default hangup on close */
-
-    /* don't try to open negative devices */
-    if(com_num < 0) {
-      fd = INVALID_HANDLE_VALUE;
-    } else {
-      fd = open_serial((unsigned int)com_num, &test);
+    if(argc > 2)
+        rxbufsize = txbufsize = atom_getfloatarg(2, argc, argv);
+    if(argc > 3)
+        txbufsize = atom_getfloatarg(3, argc, argv);
+    if(rxbufsize < COMPORT_BUF_MIN || rxbufsize > COMPORT_BUF_MAX
+        || txbufsize < COMPORT_BUF_MIN || txbufsize > COMPORT_BUF_MAX)
+    {
+        pd_error(0, "[comport] buffer sizes need to be %d to %d bytes, using %d",
+            COMPORT_BUF_MIN, COMPORT_BUF_MAX, COMPORT_BUF_SIZE);
+        rxbufsize = txbufsize = COMPORT_BUF_SIZE;
     }
 
-    /* Now  nothing really bad could happen so we create the class */
     x = (t_comport *)pd_new(comport_class);
 
-    x->comport = test.comport;/* com_num */
 #ifdef _WIN32
     strncpy_s(x->serial_device_prefix, strlen(serial_device_prefix) + 1, serial_device_prefix, strlen(serial_device_prefix) + 1);
 #else
-    strncpy(x->serial_device_prefix, serial_device_prefix, MAXPDSTRING);
+    strncpy(x->serial_device_prefix, serial_device_prefix, MAXPDSTRING-1);
+    x->serial_device_prefix[MAXPDSTRING-1] = 0;
 #endif
-    x->serial_device = test.serial_device; /* we need this so 'help' doesn't crash */
-
-    x->baud = test.baud;
-    x->data_bits = test.data_bits;
-    x->parity_bit = test.parity_bit;
-    x->stop_bits = test.stop_bits;
-    x->ctsrts = test.ctsrts;
-    x->xonxoff = test.xonxoff;
-    x->hupcl = test.hupcl;
-    x->comhandle = fd; /* holds the comport handle */
+    x->serial_device = gensym(""); /* we need this so 'help' doesn't crash */
+    x->pretty_name = x->serial_device->s_name;
+    x->comport = -1; /* none yet */
+    x->comhandle = INVALID_HANDLE_VALUE;
 
-    if(fd == INVALID_HANDLE_VALUE && com_num>=0)
-    {
-        pd_error(x, "[comport] opening serial port %d failed!", com_num);
-    }
-    else
-    {
+    x->baud = ibaud;
+    x->data_bits = 8; /* default 8 data bits */
+    x->parity_bit = 0;/* default no parity bit */
 #ifdef _WIN32
-        memcpy(&(x->dcb_old), &(test.dcb_old), sizeof(DCB)); /*  save the old com config  */
-        memcpy(&(x->dcb), &(test.dcb), sizeof(DCB)); /*  for the new com config  */
+    x->stop_bits = 1;/* default 1 stop bit */
 #else
-        /* save the old com and new com config */
-        bcopy(&(test.oldcom_termio),&(x->oldcom_termio),sizeof(struct termios));
-        bcopy(&(test.com_termio),&(x->com_termio),sizeof(struct termios));
-#endif
-    }
-
-/* allocate memory for in and out buffers */
-    x->x_inbuf = getbytes(COMPORT_BUF_SIZE);
-    if (NULL == x->x_inbuf)
-    {
-        pd_error(x, "[comport] unable to allocate input buffer");
-        return 0;
-    }
-    x->x_inbuf_len = COMPORT_BUF_SIZE;
-    x->x_outbuf = getbytes(COMPORT_BUF_SIZE);
-    if (NULL == x->x_outbuf)
-    {
-        pd_error(x, "[comport] unable to allocate output buffer");
-        return 0;
-    }
-    x->x_outbuf_len = COMPORT_BUF_SIZE;
-    x->x_outbuf_wr_index = 0;
+    x->stop_bits = 0;/* default 1 stop bit */
+#endif /* _WIN32 */
+    x->ctsrts = 0; /* default no hardware handshaking */
+    x->xonxoff = 0; /* default no software handshaking */
+    x->hupcl = 1; /* default hangup on close */
+    x->x_lowlatency = 0; /* leave the driver's batching alone */
+    x->x_latency_timer = 1;
+    x->x_lowlatency_saved = x->x_latency_timer_saved = -1;
+
+/* the in and out buffers are allocated when a device is opened */
+    x->x_inbuf = NULL;
+    x->x_inbuf_len = 0;
+    x->x_rxbufsize = rxbufsize;
+    x->x_txbufsize = txbufsize;
+    x->x_txring.r_buf = NULL;
+    x->x_txring.r_size = x->x_txring.r_head = x->x_txring.r_tail = 0;
+    x->x_txstaged = 0;
+    x->x_txscratch = NULL;
+    x->x_txscratch_size = 0;
+    x->x_txhigh = txbufsize * 3 / 4;
+    x->x_txlow = txbufsize / 4;
+    x->x_txbackpressure = 0;
 
     x->rxerrors = 0; /* holds the rx line errors */
+    x->txerrors = 0;
 
     x->x_data_outlet = outlet_new(&x->x_obj, &s_float);
     x->x_status_outlet = outlet_new(&x->x_obj, &s_float);
@@ -1487,12 +4302,95 @@ allows COM port numbers to be specified. */
     x->x_deltime = 10;
     x->x_retries = 10;
     x->x_clock = clock_new(x, (t_method)comport_tick);
+    x->x_txclock = clock_new(x, (t_method)comport_txtick);
+    x->x_sendat_clock = clock_new(x, (t_method)comport_sendat_tick);
+    comsched_init(&x->x_sendat);
+#ifndef _WIN32
+    pthread_mutex_init(&x->x_sendat_lock, 0);
+#endif
+    x->x_txmode = COMPORT_TXMODE_TICK;
+    x->x_txwindow = 0;
+
+    memset(&x->x_stats, 0, sizeof(x->x_stats));
+    memset(&x->x_rstats, 0, sizeof(x->x_rstats));
+    memset(&x->x_wstats, 0, sizeof(x->x_wstats));
+    x->x_stats_epoch = 0;
+    x->x_dataticks = x->x_emptyticks = 0;
+    x->x_tick_hasdata = 0;
+    x->x_txdropped = 0;
+    x->x_rxring_max = x->x_txqueue_max = 0;
+    x->x_ticktime = x->x_tickmax = 0;
 
     clock_delay(x->x_clock, x->x_deltime);
 
     x->x_verbose = 0;
     x->x_inprocess = 0;
 
+    x->x_blockmode = 0;
+    x->x_blocksize = 0;
+    x->x_atombuf = NULL;
+    x->x_atombuf_len = 0;
+    x->x_outputting = 0;
+    x->x_atombuf_stale = 0;
+    memset(&x->x_framer, 0, sizeof(x->x_framer));
+    x->x_framer.f_type = COMPORT_FRAME_NONE;
+    x->x_unpack = NULL;
+    x->x_unpack_nfields = x->x_unpack_size = x->x_unpack_nvalues = 0;
+    x->x_unpack_errors = 0;
+    x->x_rxarray = NULL;
+    x->x_rxarray_pos = x->x_rxarray_fill = 0;
+    x->x_rxarray_redraw = 50;
+    x->x_rxarray_drawn = 0;
+    x->x_rxarray_dirty = 0;
+    x->x_rxarray_clock = clock_new(x, (t_method)comport_record_redraw);
+    x->x_encoder = COMPORT_FRAME_NONE;
+    x->x_check = NULL;
+    x->x_check_skip = 0;
+    x->x_check_errors = 0;
+    x->x_txarray = &s_;
+    x->x_txarray_pos = x->x_txarray_n = x->x_txarray_total = 0;
+
+    x->x_timestamp = 0;
+    x->x_rxstamp = 0;
+    memset(&x->x_rxstamps, 0, sizeof(x->x_rxstamps));
+    x->x_ts_offset = x->x_ts_error = x->x_ts_synced = 0;
+
+    x->x_iomode = COMPORT_IOMODE_POLL;
+    x->x_rxring.r_buf = NULL;
+    x->x_rxring.r_size = x->x_rxring.r_head = x->x_rxring.r_tail = 0;
+#ifndef _WIN32
+    x->x_thread_running = 0;
+    x->x_thread_quit = 0;
+    x->x_thread_status = 0;
+    x->x_pollfn_registered = 0;
+    x->x_shared = 0;
+    comdevices_addinstance(x);
+    x->x_writer_running = 0;
+    x->x_writer_quit = 0;
+    x->x_writer_errors = x->x_writer_errors_seen = 0;
+    x->x_reconnect = 0;
+    x->x_reconnect_id = NULL;
+    x->x_identity = NULL;
+    x->x_reconnect_maxdelay = COMPORT_RECONNECT_MAXDELAY;
+    x->x_reconnecting = 0;
+    x->x_worker = NULL;
+    x->x_jobs = 0;
+    x->x_opening = 0;
+    x->x_generation = 0;
+    x->x_ptyslave = INVALID_HANDLE_VALUE;
+    x->x_ptyname = NULL;
+#endif
+
+    /* don't try to open negative devices */
+    if(com_num >= 0)
+    {
+        comport_open_device(x, (unsigned int)com_num);
+#ifdef _WIN32
+        if(x->comhandle == INVALID_HANDLE_VALUE)
+            pd_error(x, "[comport] opening serial port %d failed!", com_num);
+#endif
+    }
+
     return x;
 }
 
@@ -1500,11 +4398,29 @@ allows COM port numbers to be specified. */
 static void comport_free(t_comport *x)
 {
     comport_verbose("[comport] free serial...");
+#ifndef _WIN32
+    comdevices_removeinstance(x);
+#endif
+    comport_cancel(x);
+    comport_stop_io(x);
+    x->comhandle = close_serial(x);
+    comport_worker_free(x); /* it closes the device on its own */
     clock_unset(x->x_clock);
     clock_free(x->x_clock);
-    x->comhandle = close_serial(x);
-    freebytes(x->x_inbuf, x->x_inbuf_len);
-    freebytes(x->x_outbuf, x->x_outbuf_len);
+    clock_free(x->x_txclock);
+    clock_free(x->x_sendat_clock);
+    clock_free(x->x_rxarray_clock);
+    comframer_free(&x->x_framer);
+    if(x->x_unpack)
+        freebytes(x->x_unpack, x->x_unpack_nfields * sizeof(t_comfield));
+    if(x->x_atombuf)
+        freebytes(x->x_atombuf, x->x_atombuf_len * sizeof(t_atom));
+    x->x_txbackpressure = 0; /* no status output from here */
+    comport_free_buffers(x);
+    comstamps_free(&x->x_rxstamps);
+#ifndef _WIN32
+    pthread_mutex_destroy(&x->x_sendat_lock);
+#endif
 }
 
 /* ---------------- use serial settings ------------- */
@@ -1525,7 +4441,13 @@ static void comport_baud(t_comport *x,t_floatarg f)
     {
         pd_error(x,"[comport] ** ERROR ** could not set baudrate of device %s\n", x->pretty_name);
     }
-    else comport_verbose("[comport] set baudrate of %s to %d\n", x->pretty_name, x->baud);
+    else
+    {
+        comport_verbose("[comport] set baudrate of %s to %d\n", x->pretty_name, x->baud);
+#ifdef _WIN32
+        comport_output_real_baud_rate(x); /* elsewhere, once the worker has set it */
+#endif
+    }
 }
 
 static void comport_bits(t_comport *x,t_floatarg fbits)
@@ -1657,21 +4579,212 @@ static void comport_hupcl(t_comport *x,t_floatarg f)
 	set_hupcl(x, f);
 }
 
+/* lowlatency 1 [<ms>]: don't let the driver batch input (Linux only) */
+static void comport_lowlatency(t_comport *x, t_floatarg f, t_floatarg timer)
+{
+    x->x_lowlatency = (f != 0);
+    if(x->x_lowlatency)
+        x->x_latency_timer = (timer >= 1) ? (int)timer : 1;
+
+    if(x->comhandle == INVALID_HANDLE_VALUE) return; /* applied when opening */
+    if(x->x_lowlatency)
+        set_lowlatency(x, x->comhandle, 1, x->x_latency_timer);
+    else
+        restore_lowlatency(x, x->comhandle);
+    comport_verbose("[comport] lowlatency is %s", x->x_lowlatency ? "on" : "off");
+}
+
+/* reconnect 1: when the device gets lost, wait for it to come back
+   reconnect <identity>: ...for whatever device has this /dev/serial/by-id path,
+       VID:PID (like 0403:6001) or USB serial number
+   reconnect 0: retry reading 'retries' times, then give up
+   an optional second argument limits the backoff between attempts (ms) */
+static void comport_reconnect(t_comport *x, t_symbol *s, int argc, t_atom *argv)
+{
+#ifdef _WIN32
+    (void)s; (void)argc; (void)argv;
+    pd_error(x, "[comport]: reconnecting is not supported on this platform");
+#else
+    (void)s; /* squelch unused-parameter warning */
+
+    if(argc < 1)
+    {
+        pd_error(x, "[comport]: usage: reconnect <0|1|identity> [<max. delay>]");
+        return;
+    }
+    if(argc > 1)
+    {
+        int maxdelay = atom_getfloatarg(1, argc, argv);
+        x->x_reconnect_maxdelay = (maxdelay > COMPORT_RECONNECT_DELAY) ? maxdelay : COMPORT_RECONNECT_DELAY;
+    }
+    if(A_FLOAT == argv->a_type)
+    {
+        x->x_reconnect = (atom_getfloat(argv) != 0);
+        x->x_reconnect_id = NULL;
+    }
+    else
+    {
+        x->x_reconnect = 1;
+        x->x_reconnect_id = atom_getsymbol(argv);
+    }
+
+    if(!x->x_reconnect)
+    {
+        x->x_identity = NULL;
+        if(x->x_reconnecting)
+            comport_close(x); /* no one is going to send the queue now */
+        return;
+    }
+    if(x->x_reconnect_id)
+        x->x_identity = x->x_reconnect_id;
+    else if(x->comhandle != INVALID_HANDLE_VALUE)
+        comport_identify(x);
+    if(x->x_reconnecting)
+    { /* look for the new identity instead */
+        comport_cancel(x);
+        if(!comport_reconnect_start(x))
+            comport_close(x);
+    }
+#endif /* _WIN32 */
+}
+
+/* ------------------- buffers --------------------------- */
+
+/* (re)allocate the buffers with the sizes from the creation arguments or
+   'buffersize', keeping what is queued for sending as far as it fits.
+   the I/O threads must not be running */
+static int comport_alloc_buffers(t_comport *x)
+{
+    if(x->x_inbuf_len != x->x_rxbufsize)
+    {
+        unsigned char *buf = getbytes(x->x_rxbufsize);
+        if(NULL == buf)
+        {
+            pd_error(x, "[comport] unable to allocate input buffer");
+            return 0;
+        }
+        if(x->x_inbuf)
+            freebytes(x->x_inbuf, x->x_inbuf_len);
+        x->x_inbuf = buf;
+        x->x_inbuf_len = x->x_rxbufsize;
+    }
+    /* the reader thread allocates it again with the new size.
+       if it still holds something, that goes out first */
+    if(x->x_rxring.r_buf && x->x_rxring.r_size < (size_t)x->x_rxbufsize * COMPORT_RXRING_READS
+        && 0 == comring_used(&x->x_rxring))
+    {
+        comring_free(&x->x_rxring);
+        comstamps_flush(&x->x_rxstamps);
+    }
+
+    if(x->x_txring.r_size < (size_t)x->x_txbufsize
+        || x->x_txring.r_size >= (size_t)x->x_txbufsize * 2)
+    {
+        t_comring           ring;
+        const unsigned char *buf;
+        size_t              len, space;
+
+        if(!comring_init(&ring, x->x_txbufsize))
+        {
+            pd_error(x, "[comport] unable to allocate output buffer");
+            return 0;
+        }
+        while((buf = comring_readptr(&x->x_txring, &len)), len > 0)
+        {
+            unsigned char *dst = comring_writeptr(&ring, &space);
+            if(len > space) len = space;
+            if(0 == len) break;
+            memcpy(dst, buf, len);
+            comring_produce(&ring, len);
+            comring_consume(&x->x_txring, len);
+        }
+        x->x_txdropped += comring_used(&x->x_txring);
+        comring_free(&x->x_txring);
+        x->x_txring = ring;
+        x->x_txstaged = 0;
+    }
+    return comport_alloc_atombuf(x);
+}
+
+/* the buffers only exist while a device is open (or being opened),
+   so that idle objects take hardly any memory */
+static void comport_free_buffers(t_comport *x)
+{
+    x->x_txdropped += comring_used(&x->x_txring); /* unsent data is stale now */
+    x->x_txdropped += comsched_clear(&x->x_sendat); /* the I/O has stopped */
+    comring_free(&x->x_txring);
+    x->x_txstaged = 0;
+    x->x_txarray_n = 0;
+    if (x->x_txbackpressure)
+        comport_txwatermark(x);
+    comring_free(&x->x_rxring);
+    comstamps_flush(&x->x_rxstamps);
+    if(x->x_inbuf)
+        freebytes(x->x_inbuf, x->x_inbuf_len);
+    x->x_inbuf = NULL;
+    x->x_inbuf_len = 0;
+}
+
+static void comport_open_device(t_comport *x, unsigned int com_num)
+{
+    if(comport_alloc_buffers(x))
+        x->comhandle = open_serial(com_num, x);
+    if(!comport_isopen(x))
+        comport_free_buffers(x);
+}
+
+/* set the sizes of the receive (and send) buffers */
+static void comport_buffersize(t_comport *x, t_floatarg rx, t_floatarg tx)
+{
+    int open = (x->x_inbuf != NULL);
+
+    if(rx < COMPORT_BUF_MIN || rx > COMPORT_BUF_MAX
+        || (tx != 0 && (tx < COMPORT_BUF_MIN || tx > COMPORT_BUF_MAX)))
+    {
+        pd_error(x, "[comport] buffersize: need %d to %d bytes", COMPORT_BUF_MIN, COMPORT_BUF_MAX);
+        return;
+    }
+    x->x_rxbufsize = (int)rx;
+    x->x_txbufsize = (tx != 0) ? (int)tx : (int)rx;
+    x->x_txhigh = x->x_txbufsize * 3 / 4;
+    x->x_txlow = x->x_txbufsize / 4;
+    if(open)
+    { /* resize them right away */
+        comport_stop_io(x);
+        if(!comport_alloc_buffers(x))
+        {
+            comport_close(x);
+            return;
+        }
+        comport_start_io(x);
+        comport_txwatermark(x);
+        if(comring_used(&x->x_txring))
+            comport_txarm(x);
+    }
+    else if(!comport_alloc_atombuf(x))
+        x->x_blockmode = 0;
+    comport_verbose("[comport] buffersize is %d bytes in, %d bytes out", x->x_rxbufsize, x->x_txbufsize);
+}
+
 static void comport_close(t_comport *x)
 {
     clock_unset(x->x_clock);
     x->x_hit = 1;
+    comport_cancel(x);
+    comport_stop_io(x);
     x->comhandle = close_serial(x);
+    comport_free_buffers(x);
     x->comport = -1; /* none */
     if (x->x_status_outlet != NULL) outlet_float(x->x_status_outlet, (float)x->comport);
 }
 
 static void comport_open(t_comport *x, t_floatarg f)
 {
-    if(x->comhandle != INVALID_HANDLE_VALUE)
+    if(comport_isopen(x))
         comport_close(x);
 
-    x->comhandle = open_serial(f,x);
+    comport_open_device(x, f);
+    comport_start_io(x);
 
     clock_delay(x->x_clock, x->x_deltime);
 }
@@ -1683,45 +4796,51 @@ static void comport_open(t_comport *x, t_floatarg f)
 
 static void comport_devicename(t_comport *x, t_symbol *s)
 {
-    x->serial_device = s;
-    if(x->comhandle != INVALID_HANDLE_VALUE)
+    if(comport_isopen(x))
         comport_close(x);
+    x->serial_device = s;
 
-    x->comhandle = open_serial(USE_DEVICENAME,x);
+    comport_open_device(x, USE_DEVICENAME);
+    comport_start_io(x);
     clock_delay(x->x_clock, x->x_deltime);
 }
 
 static void comport_print(t_comport *x, t_symbol *s, int argc, t_atom *argv)
 {
     static char buf[256];
-    char        *pch = buf;
+    char        *pch;
     (void)s; /* squelch unused-parameter warning */
 
+    if(!comport_isopen(x))
+    {
+        comport_verbose ("[comport]: Serial port is not open");
+        return;
+    }
+    if(comport_txbusy(x)) return;
+    /* without an encoder, this just queues the whole message at once */
+    comport_txframe_begin(x);
     while(argc--)
     {
         atom_string(argv++, buf, 255);
-        while(*pch != 0)
-        {
-            write_serial(x, *pch++);
-        }
+        for(pch = buf; *pch != 0; pch++)
+            comport_txframe_put(x, *pch);
         if(argc > 0)
-        {
-            write_serial(x, ' ');
-        }
+            comport_txframe_put(x, ' ');
     }
+    comport_txframe_end(x);
 }
 
 static void comport_enum(t_comport *x)
 {
 #ifdef _WIN32
     HANDLE          fd;
-    char            device_name[10];
+    char            device_name[16];
     unsigned int    i;
     DWORD           dw;
     for(i = 1; i < COMPORT_MAX; i++)
     {
 #ifdef _MSC_VER
-        sprintf_s(device_name, 10, "%s%d", x->serial_device_prefix, i);
+        sprintf_s(device_name, sizeof(device_name), "%s%d", x->serial_device_prefix, i);
 #else
         sprintf(device_name, "%s%d", x->serial_device_prefix, i);
 #endif
@@ -1741,38 +4860,13 @@ static void comport_enum(t_comport *x)
         else if (dw == ERROR_ACCESS_DENIED)pd_error(x, "\t%d - COM%d (in use)", i, i);
     }
 #else
-    unsigned int i;
-    glob_t         glob_buffer;
-    int            fd;
-    struct termios test;
+    int             i;
+    t_comdevices    *devices = comdevices_get(x, x->serial_device_prefix);
 
-/* first look for registered devices in the filesystem */
-    switch( glob( x->serial_device_prefix, 0, NULL, &glob_buffer ) )
+    for(i = 0; devices && i < devices->d_count; i++)
     {
-    case GLOB_NOSPACE:
-        pd_error(x,"[comport] out of memory for \"%s\"",x->serial_device_prefix);
-        break;
-# ifdef GLOB_ABORTED
-        case GLOB_ABORTED:
-        pd_error(x,"[comport] aborted \"%s\"",x->serial_device_prefix);
-        break;
-# endif /* GLOB_ABORTED */
-# ifdef GLOB_NOMATCH
-    case GLOB_NOMATCH:
-        pd_error(x,"[comport] no serial devices found for \"%s\"",x->serial_device_prefix);
-        break;
-# endif /* GLOB_NOMATCH */
-    }
-    for(i=0; i<glob_buffer.gl_pathc; i++)
-    {
-/* now try to open the device */
-        if((fd = open(glob_buffer.gl_pathv[i], OPENPARAMS)) != INVALID_HANDLE_VALUE)
-        {
-/* now see if it has attributes */
-            if ((tcgetattr(fd, &test)) != -1)
-                post("\t%d\t%s", i, glob_buffer.gl_pathv[i]);// this one really exists
-            close (fd);
-        }
+        if (comdevices_usable(devices, i))
+            post("\t%d\t%s", i, devices->d_names[i]->s_name);// this one really exists
     }
 #endif  /* _WIN32 */
 }
@@ -1783,13 +4877,13 @@ static void comport_ports(t_comport *x)
     t_atom          output_atom[2];
 #ifdef _WIN32
     HANDLE          fd;
-    char            device_name[10];
+    char            device_name[16];
     DWORD           dw;
 
     for(i = 1; i < COMPORT_MAX; i++)
     {
 #ifdef _MSC_VER
-        sprintf_s(device_name, 10, "%s%d", x->serial_device_prefix, i);
+        sprintf_s(device_name, sizeof(device_name), "%s%d", x->serial_device_prefix, i);
 #else
         sprintf(device_name, "%s%d", x->serial_device_prefix, i);
 #endif
@@ -1813,40 +4907,15 @@ static void comport_ports(t_comport *x)
         }
     }
 #else
-    glob_t          glob_buffer;
-    int             fd;
-    struct termios  test;
+    t_comdevices    *devices = comdevices_get(x, x->serial_device_prefix);
 
-/* first look for registered devices in the filesystem */
-    switch( glob( x->serial_device_prefix, 0, NULL, &glob_buffer ) )
-    {
-        case GLOB_NOSPACE:
-            pd_error(x,"[comport] out of memory for \"%s\"",x->serial_device_prefix);
-            break;
-# ifdef GLOB_ABORTED
-        case GLOB_ABORTED:
-            pd_error(x,"[comport] aborted \"%s\"",x->serial_device_prefix);
-            break;
-# endif /* GLOB_ABORTED */
-# ifdef GLOB_NOMATCH
-        case GLOB_NOMATCH:
-            pd_error(x,"[comport] no serial devices found for \"%s\"",x->serial_device_prefix);
-            break;
-# endif /* GLOB_NOMATCH */
-    }
-    for(i = 0; (i < glob_buffer.gl_pathc) && (i < COMPORT_MAX); i++)
+    for(i = 0; devices && (int)i < devices->d_count; i++)
     {
-/* now try to open the device */
-        if((fd = open(glob_buffer.gl_pathv[i], OPENPARAMS)) != INVALID_HANDLE_VALUE)
-        {
-/* now see if it has attributes */
-            if ((tcgetattr(fd, &test)) != -1)
-            { /* output index and name as a list */
-                SETFLOAT(&output_atom[0], i);
-                SETSYMBOL(&output_atom[1], gensym(glob_buffer.gl_pathv[i]));
-                outlet_anything( x->x_status_outlet, gensym("ports"), 2, output_atom);
-            }
-            close (fd);
+        if (comdevices_usable(devices, i))
+        { /* output index and name as a list */
+            SETFLOAT(&output_atom[0], i);
+            SETSYMBOL(&output_atom[1], devices->d_names[i]);
+            outlet_anything( x->x_status_outlet, gensym("ports"), 2, output_atom);
         }
     }
 #endif  /* _WIN32 */
@@ -1887,6 +4956,11 @@ static void comport_output_baud_rate(t_comport *x)
     comport_output_status(x, gensym("baud"), x->baud);
 }
 
+static void comport_output_real_baud_rate(t_comport *x)
+{
+    comport_output_status(x, gensym("realbaud"), get_real_baudrate(x));
+}
+
 static void comport_output_parity_bit(t_comport *x)
 {
     comport_output_status(x, gensym("parity"), x->parity_bit);
@@ -1926,6 +5000,24 @@ static void comport_output_rxerrors(t_comport *x)
     comport_output_status(x, gensym("rxerrors"), x->rxerrors);
 }
 
+static void comport_output_framingerrors(t_comport *x)
+{
+    comport_output_status(x, gensym("framingerrors"), x->x_framer.f_errors);
+}
+
+static void comport_output_txqueued(t_comport *x)
+{
+    comport_output_status(x, gensym("txqueued"), comring_used(&x->x_txring));
+}
+
+static void comport_output_lowlatency(t_comport *x)
+{
+    int timer;
+    int flag = get_lowlatency(x, &timer);
+    comport_output_status(x, gensym("lowlatency"), flag);
+    comport_output_status(x, gensym("latencytimer"), timer);
+}
+
 static void comport_output_open_status(t_comport *x)
 {
     if(x->comhandle == INVALID_HANDLE_VALUE)
@@ -1944,6 +5036,7 @@ static void comport_info(t_comport *x)
     comport_output_open_status(x);
     comport_output_port_status(x);
     comport_output_baud_rate(x);
+    comport_output_real_baud_rate(x);
     comport_output_dsr_status(x);
     comport_output_cts_status(x);
     comport_output_parity_bit(x);
@@ -1952,7 +5045,18 @@ static void comport_info(t_comport *x)
     comport_output_rtscts(x);
     comport_output_xonxoff(x);
     comport_output_hupcl(x);
+    comport_output_lowlatency(x);
     comport_output_rxerrors(x);
+    comport_output_framingerrors(x);
+    comport_output_txqueued(x);
+#ifndef _WIN32
+    if(x->x_ptyslave != INVALID_HANDLE_VALUE)
+    {
+        t_atom at;
+        SETSYMBOL(&at, x->x_ptyname);
+        outlet_anything(x->x_status_outlet, gensym("pty"), 1, &at);
+    }
+#endif
 }
 
 /* ---------------- HELPER ------------------------- */
@@ -1971,13 +5075,13 @@ static void comport_set_inprocess(t_comport *x, t_floatarg f)
 static void comport_help(t_comport *x)
 {
     post("[comport] serial port %d (baud %d):", x->comport, x->baud);
-    if(x->comport >= 0 && x->comport < COMPORT_MAX)
+    if(x->comport >= 0)
     {
         post("\tdevicename: %s", x->pretty_name);
     }
 
     post("  Methods:");
-    post("   baud <baud>       ... set baudrate to nearest possible baud\n"
+    post("   baud <baud>       ... set baudrate (any rate on Linux, else the nearest possible one)\n"
          "   bits <bits>       ... set number of bits (7 or 8)\n"
          "   stopbit <0|1>     ... set off|on stopbit\n"
          "   rtscts <0|1>      ... set rts/cts off|on\n"
@@ -1986,11 +5090,49 @@ static void comport_help(t_comport *x)
          "   dtr <0|1>         ... set dtr off|on\n"
          "   rts <0|1>         ... set rts off|on\n"
          "   hupcl <0|1>       ... set hang-up on close off|on\n"
+         "   lowlatency <0|1> [<ms>] ... set ASYNC_LOW_LATENCY and the usb-serial latency_timer (Linux)\n"
          "   close             ... close device\n"
          "   open <num>        ... open device number num\n"
          "   devicename <d>    ... set device name to d (eg. /dev/ttyS8)\n"
+         "   devicename pty    ... create a pseudo-terminal and output 'pty <path of the other end>'\n"
+         "   reconnect <0|1|id> [<ms>] ... wait for a lost device (or the one with this by-id path,\n"
+         "                         VID:PID or serial number) to come back, retrying at most every ms\n"
          "   print <list>      ... print list of atoms on serial\n"
+         "   pack <format> <values> ... send the values as a binary record (see unpack), e.g. pack <hf 1000 0.5\n"
+         "   writearray <name> [<onset> [<n>]] [<format>] ... send the samples of an array as u8 (default), s8,\n"
+         "                         u16, s16, u32, s32 or f32 (add 'be' for big endian), any length;\n"
+         "                         outputs 'writearray <n>' when all are queued\n"
+         "   sendat <ms> <bytes> ... send the bytes that many ms of logical time from now; to the\n"
+         "                         sub-millisecond with txmode thread, else at Pd's clock ticks\n"
          "   pollintervall <t> ... set poll interval to t ticks\n"
+         "   iomode <m>        ... read in the clock (poll), in a reader thread (thread)\n"
+         "                         or when Pd sees the device is readable (event), or\n"
+         "                         from one thread for all ports in that mode (shared)\n"
+         "   blockmode <0|1> [<n>] ... output received chunks (max. n bytes) as lists\n"
+         "   frame <type> ...  ... output received frames as lists, type is one of\n"
+         "                         off, delimiter <bytes>, markers <start> <end>,\n"
+         "                         fixed <size>, length <offset> <size> [<adjust> [big]]\n"
+         "   framemax <n>      ... drop frames that grow bigger than n bytes\n"
+         "   decode <codec>    ... output decoded slip, cobs or hdlc frames (or off)\n"
+         "   recordarray <name> [<format>] [<ms>] ... write received samples (formats as writearray) into\n"
+         "                         an array as a ring buffer, redraw and output 'recordarray <index>'\n"
+         "                         at most every ms (50); 'recordarray off' outputs to the outlet again\n"
+         "   timestamp <0|1>   ... output 'timestamp <ms> <error>' before each chunk or frame: when\n"
+         "                         it was read, in ms of logical time from now (usually negative)\n"
+         "   unpack <format>   ... output the values of binary records in frames (or off), e.g. <hhhf:\n"
+         "                         < > byte order, b B h H i I q Q 8-64 bit (un)signed, f d float,\n"
+         "                         x pad byte, 3h repeats, H:4:12 bitfields\n"
+         "   encode <codec>    ... send each message as a slip, cobs or hdlc frame (or off)\n"
+         "   checksum <type> [<skip>] ... drop received frames with a bad checksum and strip it,\n"
+         "                         append it to each message sent (or off); not covering the first\n"
+         "                         skip bytes. type: crc8, crc8maxim, crc16modbus, crc16ccitt,\n"
+         "                         crc16xmodem, crc16x25, crc32, xor, sum8 or lrc\n"
+         "   buffersize <rx> [<tx>] ... bytes per read and size of the send queue (default 16384),\n"
+         "                         also the 3rd and 4th creation argument; resets txwatermarks\n"
+         "   txwatermarks <high> <low> ... output txbackpressure 1 when that many bytes are queued, 0 when drained\n"
+         "   txmode <mode>     ... write in the clock callback (tick), at the end of each message (immediate) or from a writer thread (thread)\n"
+         "   txwindow <usec>   ... wait that long for more data before writing in immediate and thread mode\n"
+         "   stats             ... output performance counters ('stats reset' clears them)\n"
          "   verbose <level>   ... for debug set verbosity to level\n"
          "   inprocess <0|1>   ... set input-processing off|on\n"
          "   info              ... output info on status outlet\n"
@@ -2022,12 +5164,35 @@ void comport_setup(void)
     class_addmethod(comport_class, (t_method)comport_parity, gensym("parity"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_xonxoff, gensym("xonxoff"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_hupcl, gensym("hupcl"), A_FLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_lowlatency, gensym("lowlatency"),
+        A_FLOAT, A_DEFFLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_close, gensym("close"), 0);
     class_addmethod(comport_class, (t_method)comport_open, gensym("open"), A_FLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_reconnect, gensym("reconnect"), A_GIMME, 0);
     class_addmethod(comport_class, (t_method)comport_devicename, gensym("devicename"), A_SYMBOL, 0);
     class_addmethod(comport_class, (t_method)comport_print, gensym("print"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_pack, gensym("pack"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_sendat, gensym("sendat"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_writearray, gensym("writearray"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_recordarray, gensym("recordarray"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_timestamp, gensym("timestamp"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_pollintervall, gensym("pollintervall"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_retries, gensym("retries"), A_FLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_iomode, gensym("iomode"), A_SYMBOL, 0);
+    class_addmethod(comport_class, (t_method)comport_blockmode, gensym("blockmode"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_frame, gensym("frame"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_framemax, gensym("framemax"), A_FLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_decode, gensym("decode"), A_SYMBOL, 0);
+    class_addmethod(comport_class, (t_method)comport_unpack, gensym("unpack"), A_GIMME, 0);
+    class_addmethod(comport_class, (t_method)comport_checksum, gensym("checksum"), A_SYMBOL, A_DEFFLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_encode, gensym("encode"), A_SYMBOL, 0);
+    class_addmethod(comport_class, (t_method)comport_buffersize, gensym("buffersize"),
+        A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_txwatermarks, gensym("txwatermarks"),
+        A_FLOAT, A_FLOAT, 0);
+    class_addmethod(comport_class, (t_method)comport_txmode, gensym("txmode"), A_SYMBOL, 0);
+    class_addmethod(comport_class, (t_method)comport_stats, gensym("stats"), A_DEFSYM, 0);
+    class_addmethod(comport_class, (t_method)comport_set_txwindow, gensym("txwindow"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_set_verbose, gensym("verbose"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_set_inprocess, gensym("inputprocess"), A_FLOAT, 0);
     class_addmethod(comport_class, (t_method)comport_help, gensym("help"), 0);
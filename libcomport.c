@@ -0,0 +1,2054 @@
+/* libcomport - the serial engine of [comport], without Pd
+
+ (c) 1998-2005  Winfried Ritsch (see LICENCE.txt)
+ Institute for Electronic Music - Graz
+
+ see libcomport.h
+*/
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* for posix_openpt() and friends */
+#endif
+
+#include "libcomport.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <strings.h> /* strcasecmp() */
+#include <pthread.h>
+#ifdef __linux__
+#include <linux/serial.h> /* ASYNC_LOW_LATENCY */
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+/* arbitrary baud rates via termios2/BOTHER. <asm/termbits.h> clashes with
+   <termios.h>, so we declare the (asm-generic) struct ourselves */
+#if defined(__linux__) && defined(TCGETS2) && !defined(__powerpc__) && \
+    !defined(__alpha__) && !defined(__sparc__) && !defined(__mips__)
+# define COMPORT_TERMIOS2
+# ifndef BOTHER
+#  define BOTHER 0010000
+# endif
+# ifndef IBSHIFT
+#  define IBSHIFT 16
+# endif
+struct termios2
+{
+    tcflag_t    c_iflag;
+    tcflag_t    c_oflag;
+    tcflag_t    c_cflag;
+    tcflag_t    c_lflag;
+    cc_t        c_line;
+    cc_t        c_cc[19];
+    speed_t     c_ispeed;
+    speed_t     c_ospeed;
+};
+#endif /* termios2 */
+
+#ifdef  IRIX
+#define OPENPARAMS (O_RDWR|O_NDELAY|O_NOCTTY)
+#define TIONREAD FIONREAD         /* re map the IOCTL function */
+#define BAUDRATE_230400 -1
+#define BAUDRATE_115200 -1
+#define BAUDRATE_57600  -1
+#define BAUDRATE_38400  B38400
+#else /* IRIX */
+#define OPENPARAMS (O_RDWR|O_NDELAY|O_NOCTTY)
+#define BAUDRATE_230400 B230400
+#define BAUDRATE_115200 B115200
+#define BAUDRATE_57600  B57600
+#define BAUDRATE_38400  B38400
+#endif /* else IRIX */
+
+#define COMPORT_BYID_DIR "/dev/serial/by-id" /* udev's stable links to USB serial devices */
+
+/* the bits comserial_set_...() take care of */
+#define COMPORT_CFLAGS (CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS)
+#define COMPORT_IFLAGS (IXON | IXOFF | IXANY)
+
+typedef struct baudbits_ {
+  long rate;
+  long speedbits;
+} baudbits_t;
+
+static
+baudbits_t baudbitstable[] = {
+#ifdef B4000000
+  {4000000, B4000000},
+#endif
+#ifdef B3500000
+  {3500000, B3500000},
+#endif
+#ifdef B3000000
+  {3000000, B3000000},
+#endif
+#ifdef B2500000
+  {2500000, B2500000},
+#endif
+#ifdef B2000000
+  {2000000, B2000000},
+#endif
+#ifdef B1500000
+  {1500000, B1500000},
+#endif
+#ifdef B1152000
+  {1152000, B1152000},
+#endif
+#ifdef B1000000
+  {1000000, B1000000},
+#endif
+#ifdef B921600
+  {921600, B921600},
+#endif
+#ifdef B576000
+  {576000, B576000},
+#endif
+#ifdef B500000
+  {500000, B500000},
+#endif
+#ifdef B460800
+  {460800, B460800},
+#endif
+#ifdef B230400
+  {230400, B230400},
+#else
+  /* previously, this was supported without an #ifdef */
+# warning baudrate 230400 not supported (anymore)?
+#endif
+#ifdef B115200
+  {115200, B115200},
+#endif
+#ifdef B57600
+  {57600, B57600},
+#endif
+#ifdef B38400
+  {38400, B38400},
+#endif
+  {19200, B19200},
+  {9600, B9600},
+  {4800, B4800},
+  {2400, B2400},
+  {1800, B1800},
+  {1200, B1200},
+  {600, B600},
+  {300, B300},
+  {200, B200},
+  {150, B150},
+  {134, B134},
+  {110, B110},
+  {75, B75},
+  {50, B50},
+  {0, B0}
+};
+#endif /* !_WIN32 */
+
+/* ------------------------------ ring ------------------------------ */
+
+int comring_init(t_comring *r, size_t minsize)
+{
+    size_t size = 1;
+    while(size < minsize) size <<= 1;
+    r->r_buf = (unsigned char *)malloc(size);
+    if(NULL == r->r_buf)
+    {
+        r->r_size = 0;
+        return 0;
+    }
+    r->r_size = size;
+    r->r_head = r->r_tail = 0;
+    return 1;
+}
+
+void comring_free(t_comring *r)
+{
+    free(r->r_buf);
+    r->r_buf = NULL;
+    r->r_size = r->r_head = r->r_tail = 0;
+}
+
+unsigned char *comring_writeptr(t_comring *r, size_t *len)
+{
+    size_t head = r->r_head;
+    size_t space = r->r_size - (head - comport_load_acquire(&r->r_tail));
+    size_t offset = head & (r->r_size - 1);
+    if(space > r->r_size - offset) space = r->r_size - offset;
+    *len = space;
+    return r->r_buf + offset;
+}
+
+void comring_produce(t_comring *r, size_t len)
+{
+    comport_store_release(&r->r_head, r->r_head + len);
+}
+
+const unsigned char *comring_readptr(t_comring *r, size_t *len)
+{
+    size_t tail = r->r_tail;
+    size_t used = comport_load_acquire(&r->r_head) - tail;
+    size_t offset = tail & (r->r_size - 1);
+    if(used > r->r_size - offset) used = r->r_size - offset;
+    *len = used;
+    return r->r_buf + offset;
+}
+
+void comring_consume(t_comring *r, size_t len)
+{
+    comport_store_release(&r->r_tail, r->r_tail + len);
+}
+
+size_t comring_used(t_comring *r)
+{
+    return comport_load_acquire(&r->r_head) - comport_load_acquire(&r->r_tail);
+}
+
+int comring_stage(t_comring *r, size_t offset, unsigned char c)
+{
+    size_t pos = r->r_head + offset;
+    if(pos - comport_load_acquire(&r->r_tail) >= r->r_size)
+        return 0;
+    r->r_buf[pos & (r->r_size - 1)] = c;
+    return 1;
+}
+
+void comring_patch(t_comring *r, size_t offset, unsigned char c)
+{
+    r->r_buf[(r->r_head + offset) & (r->r_size - 1)] = c;
+}
+
+void comring_flush(t_comring *r)
+{
+    comport_store_release(&r->r_tail, comport_load_acquire(&r->r_head));
+}
+
+/* ------------------------------ stats ----------------------------- */
+
+void comstats_clear(t_comstats *st)
+{
+    comport_store_release(&st->s_rxbytes, 0);
+    comport_store_release(&st->s_txbytes, 0);
+    comport_store_release(&st->s_reads, 0);
+    comport_store_release(&st->s_writes, 0);
+    comport_store_release(&st->s_maxread, 0);
+    comport_store_release(&st->s_timed, 0);
+    comport_store_release(&st->s_latesum, 0);
+    comport_store_release(&st->s_latemin, 0);
+    comport_store_release(&st->s_latemax, 0);
+}
+
+void comstats_read(t_comstats *st, long n)
+{
+    comport_store_release(&st->s_reads, st->s_reads + 1);
+    if(n <= 0) return;
+    comport_store_release(&st->s_rxbytes, st->s_rxbytes + n);
+    if((unsigned long)n > st->s_maxread)
+        comport_store_release(&st->s_maxread, n);
+}
+
+void comstats_write(t_comstats *st, long n)
+{
+    comport_store_release(&st->s_writes, st->s_writes + 1);
+    if(n > 0)
+        comport_store_release(&st->s_txbytes, st->s_txbytes + n);
+}
+
+void comstats_late(t_comstats *st, double ms)
+{
+    long usec = (long)(ms * 1000.);
+    if(0 == st->s_timed || usec < st->s_latemin)
+        comport_store_release(&st->s_latemin, usec);
+    if(0 == st->s_timed || usec > st->s_latemax)
+        comport_store_release(&st->s_latemax, usec);
+    comport_store_release(&st->s_latesum, st->s_latesum + usec);
+    /* last, so that a reader who sees the count sees the rest */
+    comport_store_release(&st->s_timed, st->s_timed + 1);
+}
+
+/* ---------------------------- timestamps -------------------------- */
+
+double comclock_now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER        now;
+    if(!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000. / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000. + ts.tv_nsec * 1e-6;
+#endif
+}
+
+int comstamps_init(t_comstamps *t, size_t minsize)
+{
+    size_t size = 1;
+    while(size < minsize) size <<= 1;
+    t->t_time = (double *)malloc(size * sizeof(double));
+    t->t_end = (size_t *)malloc(size * sizeof(size_t));
+    t->t_head = t->t_tail = 0;
+    if(NULL == t->t_time || NULL == t->t_end)
+    {
+        comstamps_free(t);
+        return 0;
+    }
+    t->t_size = size;
+    return 1;
+}
+
+void comstamps_free(t_comstamps *t)
+{
+    free(t->t_time);
+    free(t->t_end);
+    t->t_time = NULL;
+    t->t_end = NULL;
+    t->t_size = t->t_head = t->t_tail = 0;
+}
+
+void comstamps_push(t_comstamps *t, size_t end, double time)
+{
+    size_t head = t->t_head;
+    if(head - comport_load_acquire(&t->t_tail) >= t->t_size)
+        return;
+    t->t_time[head & (t->t_size - 1)] = time;
+    t->t_end[head & (t->t_size - 1)] = end;
+    comport_store_release(&t->t_head, head + 1);
+}
+
+int comstamps_find(t_comstamps *t, size_t pos, double *time, size_t *end)
+{
+    size_t head = comport_load_acquire(&t->t_head), tail = t->t_tail;
+
+    /* forget the reads that have been taken completely */
+    while(tail != head && t->t_end[tail & (t->t_size - 1)] <= pos)
+        tail++;
+    comport_store_release(&t->t_tail, tail);
+    if(tail == head)
+        return 0;
+    *time = t->t_time[tail & (t->t_size - 1)];
+    *end = t->t_end[tail & (t->t_size - 1)];
+    return 1;
+}
+
+void comstamps_flush(t_comstamps *t)
+{
+    comport_store_release(&t->t_tail, comport_load_acquire(&t->t_head));
+}
+
+/* ---------------------------- scheduling -------------------------- */
+
+void comsched_init(t_comsched *s)
+{
+    s->s_head = s->s_tail = NULL;
+    s->s_count = s->s_bytes = 0;
+}
+
+int comsched_add(t_comsched *s, double due, const unsigned char *buf, size_t len)
+{
+    t_comtimed *t = (t_comtimed *)malloc(sizeof(t_comtimed) + len);
+    t_comtimed **prev;
+
+    if(NULL == t)
+        return 0;
+    t->t_due = due;
+    t->t_len = len;
+    memcpy(t->t_data, buf, len);
+    t->t_next = NULL;
+    /* they mostly come in order: append without walking the list */
+    if(NULL == s->s_tail || s->s_tail->t_due <= due)
+        prev = s->s_tail ? &s->s_tail->t_next : &s->s_head;
+    else
+    {
+        for(prev = &s->s_head; (*prev)->t_due <= due; prev = &(*prev)->t_next);
+        t->t_next = *prev;
+    }
+    *prev = t;
+    if(NULL == t->t_next)
+        s->s_tail = t;
+    s->s_count++;
+    s->s_bytes += len;
+    return 1;
+}
+
+int comsched_next(const t_comsched *s, double *due)
+{
+    if(NULL == s->s_head)
+        return 0;
+    *due = s->s_head->t_due;
+    return 1;
+}
+
+t_comtimed *comsched_take(t_comsched *s, double now)
+{
+    t_comtimed *t = s->s_head;
+
+    if(NULL == t || t->t_due > now)
+        return NULL;
+    s->s_head = t->t_next;
+    if(NULL == s->s_head)
+        s->s_tail = NULL;
+    s->s_count--;
+    s->s_bytes -= t->t_len;
+    t->t_next = NULL;
+    return t;
+}
+
+void comtimed_free(t_comtimed *t)
+{
+    free(t);
+}
+
+size_t comsched_clear(t_comsched *s)
+{
+    size_t bytes = s->s_bytes;
+
+    while(s->s_head)
+    {
+        t_comtimed *t = s->s_head;
+        s->s_head = t->t_next;
+        free(t);
+    }
+    comsched_init(s);
+    return bytes;
+}
+
+/* ----------------------------- framing ---------------------------- */
+
+int comframer_setmax(t_comframer *f, int max)
+{
+    if(max < 1) max = 1;
+    if(f->f_buf && max != f->f_max)
+    {
+        free(f->f_buf);
+        f->f_buf = NULL;
+    }
+    if(NULL == f->f_buf)
+        f->f_buf = (unsigned char *)malloc(max);
+    f->f_max = f->f_buf ? max : 0;
+    f->f_fill = 0;
+    f->f_inside = f->f_skipping = f->f_escape = 0;
+    return (f->f_buf != NULL);
+}
+
+void comframer_free(t_comframer *f)
+{
+    free(f->f_buf);
+    f->f_buf = NULL;
+    f->f_max = f->f_fill = 0;
+}
+
+static unsigned long comframer_getlength(const t_comframer *f)
+{
+    const unsigned char *p = f->f_buf + f->f_len_offset;
+    unsigned long value = 0;
+    int i;
+    if(f->f_len_bigendian)
+        for(i = 0; i < f->f_len_size; i++) value = (value << 8) | p[i];
+    else
+        for(i = f->f_len_size - 1; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+/* how many bytes the current fixed or length-prefixed frame needs,
+   (just the header, as long as we haven't got it), or -1 if it can't fit */
+static int comframer_want(const t_comframer *f)
+{
+    int header = f->f_len_offset + f->f_len_size;
+    long total;
+
+    if(COMPORT_FRAME_FIXED == f->f_type)
+        return f->f_fixed;
+    if(f->f_fill < header)
+        return header;
+    total = header + (long)comframer_getlength(f) + f->f_len_adjust;
+    if(total < header || total > f->f_max)
+        return -1;
+    return (int)total;
+}
+
+/* decode a COBS frame (without the 0 delimiter) in place,
+   returns the decoded length or -1 if the frame is malformed */
+static int comframer_cobs_decode(unsigned char *buf, int len)
+{
+    int in = 0, out = 0;
+
+    while(in < len)
+    {
+        int code = buf[in++];
+        if(0 == code || in + code - 1 > len)
+            return -1;
+        memmove(buf + out, buf + in, code - 1);
+        out += code - 1;
+        in += code - 1;
+        if(code != 0xFF && in < len)
+            buf[out++] = 0;
+    }
+    return out;
+}
+
+/* SLIP and HDLC: unstuff one byte */
+static void comframer_unstuff(t_comframer *f, unsigned char c,
+    t_comframe_fn fn, void *owner)
+{
+    int slip = (COMPORT_FRAME_SLIP == f->f_type);
+    unsigned char end = slip ? SLIP_END : HDLC_FLAG;
+    unsigned char esc = slip ? SLIP_ESC : HDLC_ESC;
+
+    if(c == end)
+    {
+        if(f->f_escape)
+        { /* an escaped delimiter aborts the frame */
+            f->f_errors++;
+        }
+        else if(!f->f_skipping && f->f_fill > 0)
+            fn(owner, f->f_buf, f->f_fill);
+        f->f_fill = 0;
+        f->f_skipping = f->f_escape = 0;
+        return;
+    }
+    if(f->f_skipping)
+        return;
+    if(c == esc)
+    {
+        f->f_escape = 1;
+        return;
+    }
+    if(f->f_escape)
+    {
+        f->f_escape = 0;
+        if(slip)
+        {
+            if(SLIP_ESC_END == c) c = SLIP_END;
+            else if(SLIP_ESC_ESC == c) c = SLIP_ESC;
+            else
+            {
+                f->f_errors++;
+                f->f_skipping = 1;
+                return;
+            }
+        }
+        else
+            c ^= HDLC_XOR;
+    }
+    if(f->f_fill == f->f_max)
+    {
+        f->f_errors++;
+        f->f_skipping = 1;
+        return;
+    }
+    f->f_buf[f->f_fill++] = c;
+}
+
+void comframer_push(t_comframer *f, const unsigned char *buf, int len,
+    t_comframe_fn fn, void *owner)
+{
+    const unsigned char *end = buf + len;
+
+    /* fn() may reconfigure or free the framer, so check every time */
+    while(buf < end && f->f_buf)
+    {
+        switch(f->f_type)
+        {
+        case COMPORT_FRAME_DELIMITER:
+            if(1 == f->f_delim_len)
+            { /* fast path: copy everything up to the delimiter at once */
+                const unsigned char *d = memchr(buf, f->f_delim[0], end - buf);
+                int n = (d ? d : end) - buf;
+                if(f->f_skipping)
+                    n = 0;
+                else if(f->f_fill + n > f->f_max)
+                {
+                    f->f_errors++;
+                    f->f_fill = n = 0;
+                    f->f_skipping = 1;
+                }
+                memcpy(f->f_buf + f->f_fill, buf, n);
+                f->f_fill += n;
+                if(NULL == d)
+                    return;
+                buf = d + 1;
+                if(!f->f_skipping && f->f_fill > 0)
+                    fn(owner, f->f_buf, f->f_fill);
+                f->f_fill = 0;
+                f->f_skipping = 0;
+            }
+            else
+            {
+                int dlen = f->f_delim_len;
+                if(f->f_fill == f->f_max)
+                { /* keep just enough to recognize the delimiter */
+                    if(!f->f_skipping) f->f_errors++;
+                    f->f_skipping = 1;
+                    memmove(f->f_buf, f->f_buf + f->f_fill - (dlen - 1), dlen - 1);
+                    f->f_fill = dlen - 1;
+                }
+                f->f_buf[f->f_fill++] = *buf++;
+                if(f->f_fill >= dlen
+                    && !memcmp(f->f_buf + f->f_fill - dlen, f->f_delim, dlen))
+                {
+                    if(!f->f_skipping && f->f_fill > dlen)
+                        fn(owner, f->f_buf, f->f_fill - dlen);
+                    f->f_fill = 0;
+                    f->f_skipping = 0;
+                }
+            }
+            break;
+        case COMPORT_FRAME_MARKERS:
+            if(!f->f_inside)
+            {
+                const unsigned char *d = memchr(buf, f->f_delim[0], end - buf);
+                if(NULL == d)
+                    return;
+                buf = d + 1;
+                f->f_inside = 1;
+                f->f_fill = 0;
+            }
+            else
+            {
+                unsigned char c = *buf++;
+                if(c == f->f_delim[1])
+                {
+                    /* with identical markers, the end of one frame starts the next */
+                    f->f_inside = (f->f_delim[0] == f->f_delim[1]);
+                    if(f->f_fill > 0)
+                        fn(owner, f->f_buf, f->f_fill);
+                    f->f_fill = 0;
+                }
+                else if(f->f_fill == f->f_max)
+                {
+                    f->f_errors++;
+                    f->f_inside = 0;
+                    f->f_fill = 0;
+                }
+                else
+                    f->f_buf[f->f_fill++] = c;
+            }
+            break;
+        case COMPORT_FRAME_FIXED:
+        case COMPORT_FRAME_LENGTH:
+        {
+            int want = comframer_want(f), n;
+            if(want >= 0)
+            {
+                n = want - f->f_fill;
+                if(n > end - buf) n = end - buf;
+                memcpy(f->f_buf + f->f_fill, buf, n);
+                f->f_fill += n;
+                buf += n;
+                if(f->f_fill == want)
+                    want = comframer_want(f); /* the header might be all there is */
+            }
+            if(want < 0)
+            { /* bogus length: drop what we have and start over */
+                f->f_errors++;
+                f->f_fill = 0;
+            }
+            else if(f->f_fill == want)
+            {
+                fn(owner, f->f_buf, f->f_fill);
+                f->f_fill = 0;
+            }
+            break;
+        }
+        case COMPORT_FRAME_SLIP:
+        case COMPORT_FRAME_HDLC:
+            comframer_unstuff(f, *buf++, fn, owner);
+            break;
+        case COMPORT_FRAME_COBS:
+        {
+            const unsigned char *d = memchr(buf, 0, end - buf);
+            int n = (d ? d : end) - buf;
+            if(f->f_skipping)
+                n = 0;
+            else if(f->f_fill + n > f->f_max)
+            {
+                f->f_errors++;
+                f->f_fill = n = 0;
+                f->f_skipping = 1;
+            }
+            memcpy(f->f_buf + f->f_fill, buf, n);
+            f->f_fill += n;
+            if(NULL == d)
+                return;
+            buf = d + 1;
+            if(!f->f_skipping && f->f_fill > 0)
+            {
+                int declen = comframer_cobs_decode(f->f_buf, f->f_fill);
+                if(declen < 0)
+                    f->f_errors++;
+                else if(declen > 0)
+                    fn(owner, f->f_buf, declen);
+            }
+            f->f_fill = 0;
+            f->f_skipping = 0;
+            break;
+        }
+        default:
+            return;
+        }
+    }
+}
+
+/* ----------------------------- records ---------------------------- */
+
+void comformat_init(t_comformat *m, const char *fmt)
+{
+    m->m_next = fmt;
+    m->m_bigendian = 0;
+    m->m_repeat = 0;
+}
+
+int comformat_next(t_comformat *m, t_comfield *f)
+{
+    const char *p = m->m_next;
+    int count = 0, used = 0;
+
+    if(m->m_repeat > 0)
+    {
+        m->m_repeat--;
+        *f = m->m_field;
+        return 1;
+    }
+    for(;; p++)
+    {
+        if('<' == *p)
+            m->m_bigendian = 0;
+        else if('>' == *p || '!' == *p)
+            m->m_bigendian = 1;
+        else if(' ' != *p)
+            break;
+    }
+    m->m_next = p;
+    if(!*p) return 0;
+    if(*p >= '0' && *p <= '9')
+    {
+        while(*p >= '0' && *p <= '9' && count <= 65536)
+            count = count * 10 + (*p++ - '0');
+        if(count < 1 || count > 65536)
+            return -1;
+        m->m_next = p;
+    }
+    f->f_type = *p;
+    f->f_bigendian = m->m_bigendian;
+    f->f_nbits = 0;
+    switch(*p)
+    {
+        case 'x': case 'b': case 'B':
+            f->f_size = 1;
+            break;
+        case 'h': case 'H':
+            f->f_size = 2;
+            break;
+        case 'i': case 'I': case 'f':
+            f->f_size = 4;
+            break;
+        case 'q': case 'Q': case 'd':
+            f->f_size = 8;
+            break;
+        default:
+            return -1;
+    }
+    p++;
+    /* bitfields, only for integers */
+    while(':' == *p && f->f_type != 'x' && f->f_type != 'f' && f->f_type != 'd')
+    {
+        int width = 0;
+        m->m_next = p++;
+        if(*p < '0' || *p > '9')
+            return -1;
+        while(*p >= '0' && *p <= '9' && width <= 64)
+            width = width * 10 + (*p++ - '0');
+        if(width < 1 || used + width > f->f_size * 8)
+            return -1;
+        used += width;
+        f->f_bits[f->f_nbits++] = width;
+    }
+    m->m_next = p;
+    if(count > 1)
+    {
+        m->m_field = *f;
+        m->m_repeat = count - 1;
+    }
+    return 1;
+}
+
+int comformat_measure(const char *fmt, int *size, int *nfields, int *nvalues)
+{
+    t_comformat m;
+    t_comfield  f;
+    int         res;
+
+    *size = *nfields = *nvalues = 0;
+    comformat_init(&m, fmt);
+    while((res = comformat_next(&m, &f)) > 0)
+    {
+        *size += f.f_size;
+        *nfields += 1;
+        *nvalues += comfield_nvalues(&f);
+        if(*size > (1 << 24))
+            return 0;
+    }
+    return res == 0;
+}
+
+unsigned long long comfield_load(const t_comfield *f, const unsigned char *p)
+{
+    unsigned long long raw = 0;
+    int                i;
+
+    if(f->f_bigendian)
+        for(i = 0; i < f->f_size; i++)
+            raw = (raw << 8) | p[i];
+    else
+        for(i = f->f_size - 1; i >= 0; i--)
+            raw = (raw << 8) | p[i];
+    return raw;
+}
+
+void comfield_store(const t_comfield *f, unsigned long long raw, unsigned char *p)
+{
+    int i;
+
+    for(i = 0; i < f->f_size; i++, raw >>= 8)
+        p[f->f_bigendian ? f->f_size - 1 - i : i] = raw & 0xFF;
+}
+
+/* where the i-th value is in the raw bits */
+static void comfield_position(const t_comfield *f, int i, int *shift, int *width)
+{
+    int k;
+
+    *shift = 0;
+    *width = f->f_size * 8;
+    if(!f->f_nbits) return;
+    for(k = 0; k < i; k++)
+        *shift += f->f_bits[k];
+    *width = f->f_bits[i];
+}
+
+double comfield_value(const t_comfield *f, unsigned long long raw, int i)
+{
+    unsigned long long mask;
+    int                shift, width;
+
+    if('f' == f->f_type)
+    {
+        uint32_t u = (uint32_t)raw;
+        float    v;
+        memcpy(&v, &u, sizeof(v));
+        return v;
+    }
+    if('d' == f->f_type)
+    {
+        double v;
+        memcpy(&v, &raw, sizeof(v));
+        return v;
+    }
+    comfield_position(f, i, &shift, &width);
+    mask = (width < 64) ? (1ULL << width) - 1 : ~0ULL;
+    raw = (raw >> shift) & mask;
+    /* lower case types are signed */
+    if(f->f_type >= 'a' && f->f_type <= 'z')
+    {
+        if((raw >> (width - 1)) & 1)
+            raw |= ~mask;
+        return (double)(long long)raw;
+    }
+    return (double)raw;
+}
+
+unsigned long long comfield_setvalue(const t_comfield *f, unsigned long long raw,
+    int i, double v)
+{
+    unsigned long long bits, mask;
+    int                shift, width;
+
+    if('f' == f->f_type)
+    {
+        float    fv = (float)v;
+        uint32_t u;
+        memcpy(&u, &fv, sizeof(u));
+        return u;
+    }
+    if('d' == f->f_type)
+    {
+        memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+    comfield_position(f, i, &shift, &width);
+    mask = (width < 64) ? (1ULL << width) - 1 : ~0ULL;
+    if(v != v) /* NaN */
+        bits = 0;
+    else if(f->f_type >= 'a' && f->f_type <= 'z')
+    {
+        double max = (double)(1ULL << (width - 1));
+        if(v >= max)
+            bits = mask >> 1;
+        else if(v < -max)
+            bits = ~(mask >> 1);
+        else
+            bits = (unsigned long long)(long long)v;
+    }
+    else
+    {
+        double max = (width < 64) ? (double)(1ULL << width) : 18446744073709551616.0;
+        if(v >= max)
+            bits = mask;
+        else if(v <= 0)
+            bits = 0;
+        else
+            bits = (unsigned long long)v;
+    }
+    return (raw & ~(mask << shift)) | ((bits & mask) << shift);
+}
+
+/* ---------------------------- checksums --------------------------- */
+
+#define COMCHECK_CRC 0
+#define COMCHECK_XOR 1
+#define COMCHECK_SUM 2
+#define COMCHECK_LRC 3
+
+struct comcheck
+{
+    const char      *c_name;
+    int             c_kind; /* COMCHECK_... */
+    int             c_width; /* in bits */
+    uint32_t        c_poly; /* CRCs: in normal (MSB first) notation */
+    uint32_t        c_init;
+    uint32_t        c_xorout;
+    char            c_reflected; /* least significant bit first */
+    uint32_t        (*c_table)[256]; /* slice-by-8 tables, built on first use */
+};
+
+static struct comcheck comcheck_list[] =
+{
+    {"crc8",        COMCHECK_CRC,  8, 0x07,       0x00,       0x00,       0, NULL},
+    {"crc8maxim",   COMCHECK_CRC,  8, 0x31,       0x00,       0x00,       1, NULL},
+    {"crc16modbus", COMCHECK_CRC, 16, 0x8005,     0xFFFF,     0x0000,     1, NULL},
+    {"crc16ccitt",  COMCHECK_CRC, 16, 0x1021,     0xFFFF,     0x0000,     0, NULL},
+    {"crc16xmodem", COMCHECK_CRC, 16, 0x1021,     0x0000,     0x0000,     0, NULL},
+    {"crc16x25",    COMCHECK_CRC, 16, 0x1021,     0xFFFF,     0xFFFF,     1, NULL},
+    {"crc32",       COMCHECK_CRC, 32, 0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, 1, NULL},
+    {"xor",         COMCHECK_XOR,  8, 0, 0, 0, 0, NULL},
+    {"sum8",        COMCHECK_SUM,  8, 0, 0, 0, 0, NULL},
+    {"lrc",         COMCHECK_LRC,  8, 0, 0, 0, 0, NULL},
+};
+#define COMCHECK_COUNT (sizeof(comcheck_list) / sizeof(comcheck_list[0]))
+
+static uint32_t comcheck_reflect(uint32_t v, int width)
+{
+    uint32_t r = 0;
+    int      i;
+
+    for(i = 0; i < width; i++, v >>= 1)
+        r = (r << 1) | (v & 1);
+    return r;
+}
+
+/* t[0] is the usual byte-at-a-time table, t[k][n] is the CRC of byte n
+   followed by k zero bytes. reflected CRCs are kept in the low bits of the
+   state, the others in the high bits, so that both work on 32 bits */
+static int comcheck_build(struct comcheck *c)
+{
+    uint32_t (*t)[256] = (uint32_t (*)[256])malloc(8 * sizeof(*t));
+    uint32_t poly = c->c_reflected ? comcheck_reflect(c->c_poly, c->c_width)
+        : c->c_poly << (32 - c->c_width);
+    int      n, k;
+
+    if(NULL == t) return 0;
+    for(n = 0; n < 256; n++)
+    {
+        uint32_t crc;
+        if(c->c_reflected)
+            for(crc = n, k = 0; k < 8; k++)
+                crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+        else
+            for(crc = (uint32_t)n << 24, k = 0; k < 8; k++)
+                crc = (crc & 0x80000000) ? (crc << 1) ^ poly : crc << 1;
+        t[0][n] = crc;
+    }
+    for(k = 1; k < 8; k++)
+        for(n = 0; n < 256; n++)
+            t[k][n] = c->c_reflected
+                ? (t[k-1][n] >> 8) ^ t[0][t[k-1][n] & 0xFF]
+                : (t[k-1][n] << 8) ^ t[0][t[k-1][n] >> 24];
+    c->c_table = t;
+    return 1;
+}
+
+const t_comcheck *comcheck_find(const char *name)
+{
+    size_t i;
+
+    for(i = 0; i < COMCHECK_COUNT; i++)
+    {
+        struct comcheck *c = comcheck_list + i;
+        if(strcmp(name, c->c_name))
+            continue;
+        if(COMCHECK_CRC == c->c_kind && NULL == c->c_table && !comcheck_build(c))
+            return NULL;
+        return c;
+    }
+    return NULL;
+}
+
+const char *comcheck_names(void)
+{
+    return "crc8, crc8maxim, crc16modbus, crc16ccitt, crc16xmodem, crc16x25, crc32, xor, sum8, lrc";
+}
+
+int comcheck_size(const t_comcheck *c)
+{
+    return c->c_width / 8;
+}
+
+unsigned long comcheck_start(const t_comcheck *c)
+{
+    if(COMCHECK_CRC != c->c_kind)
+        return 0;
+    return c->c_reflected ? comcheck_reflect(c->c_init, c->c_width)
+        : c->c_init << (32 - c->c_width);
+}
+
+unsigned long comcheck_update(const t_comcheck *c, unsigned long state,
+    const unsigned char *p, size_t len)
+{
+    uint32_t (*t)[256] = c->c_table;
+    uint32_t crc = (uint32_t)state;
+
+    switch(c->c_kind)
+    {
+        case COMCHECK_XOR:
+        {
+            uint64_t acc = 0, w;
+            for(; len >= 8; p += 8, len -= 8)
+            {
+                memcpy(&w, p, 8);
+                acc ^= w;
+            }
+            while(len--)
+                crc ^= *p++;
+            for(; acc; acc >>= 8)
+                crc ^= acc & 0xFF;
+            return crc & 0xFF;
+        }
+        case COMCHECK_SUM:
+        case COMCHECK_LRC:
+            while(len--)
+                crc += *p++;
+            return crc & 0xFF;
+        default:
+            break;
+    }
+    if(c->c_reflected)
+    {
+        for(; len >= 8; p += 8, len -= 8)
+        {
+            uint32_t lo = crc ^ (p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+                ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        }
+        while(len--)
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    }
+    else
+    {
+        for(; len >= 8; p += 8, len -= 8)
+        {
+            uint32_t hi = crc ^ ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+            crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xFF] ^ t[5][(hi >> 8) & 0xFF] ^ t[4][hi & 0xFF]
+                ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        }
+        while(len--)
+            crc = (crc << 8) ^ t[0][(crc >> 24) ^ *p++];
+    }
+    return crc;
+}
+
+void comcheck_finish(const t_comcheck *c, unsigned long state, unsigned char *sum)
+{
+    uint32_t value = (uint32_t)state;
+    int      i, size = comcheck_size(c);
+
+    if(COMCHECK_LRC == c->c_kind)
+        value = -value;
+    else if(COMCHECK_CRC == c->c_kind && !c->c_reflected)
+        value >>= 32 - c->c_width;
+    value ^= c->c_xorout;
+    /* reflected CRCs go out low byte first */
+    for(i = 0; i < size; i++, value >>= 8)
+        sum[c->c_reflected ? i : size - 1 - i] = value & 0xFF;
+}
+
+int comcheck_verify(const t_comcheck *c, const unsigned char *buf, size_t len)
+{
+    unsigned char sum[4];
+    size_t        size = comcheck_size(c);
+
+    if(len < size)
+        return 0;
+    len -= size;
+    comcheck_finish(c, comcheck_update(c, comcheck_start(c), buf, len), sum);
+    return !memcmp(sum, buf + len, size);
+}
+
+/* ----------------------------- devices ---------------------------- */
+#ifndef _WIN32
+
+/* termios can only do the rates in baudbitstable, termios2 can do any */
+static int is_standard_baudrate(long baud)
+{
+    unsigned int i;
+    for(i = 0; i < sizeof(baudbitstable) / sizeof(*baudbitstable); i++)
+        if(baudbitstable[i].rate == baud)
+            return 1;
+    return 0;
+}
+
+long comserial_set_baudrate(t_comconfig *cfg, long baud)
+{
+    struct termios      *tio = &cfg->c_termios;
+    const baudbits_t    *b = baudbitstable;
+
+#ifdef COMPORT_TERMIOS2
+    if(baud > 0 && !is_standard_baudrate(baud))
+    { /* termios keeps a valid placeholder, comserial_configure() applies the real rate */
+        cfg->c_custom_baud = baud;
+        cfsetispeed(tio, B38400);
+        cfsetospeed(tio, B38400);
+        return baud;
+    }
+#endif
+    cfg->c_custom_baud = 0;
+    if(baud < 0)
+        baud = 9600;
+    while(b->rate > baud) b++; /* the table is sorted and ends with 0 */
+    cfsetispeed(tio, b->speedbits);
+    cfsetospeed(tio, b->speedbits);
+    return b->rate;
+}
+
+int comserial_set_databits(t_comconfig *cfg, int bits)
+{
+    struct termios *tio = &cfg->c_termios;
+    tio->c_cflag &= ~CSIZE;
+    switch(bits)
+    {
+        case 5: tio->c_cflag |= CS5; return 5;
+        case 6: tio->c_cflag |= CS6; return 6;
+        case 7: tio->c_cflag |= CS7; return 7;
+        default: tio->c_cflag |= CS8;
+    }
+    return 8;
+}
+
+int comserial_set_parity(t_comconfig *cfg, int parity)
+{
+    struct termios *tio = &cfg->c_termios;
+
+    switch(parity)
+    {
+        case 1:
+            tio->c_cflag |= PARENB;  tio->c_cflag &= ~PARODD; return 1;
+        case -1:
+            tio->c_cflag |= PARENB | PARODD; return -1;
+        default:
+            tio->c_cflag &= ~PARENB;
+    }
+    return 0;
+}
+
+int comserial_set_stopbits(t_comconfig *cfg, int two)
+{
+    struct termios *tio = &cfg->c_termios;
+
+    if(two == 1)
+    {
+        tio->c_cflag |= CSTOPB;
+        return 1;
+    }
+    tio->c_cflag &= ~CSTOPB;
+    return 0;
+}
+
+int comserial_set_rtscts(t_comconfig *cfg, int on)
+{
+    struct termios *tio = &cfg->c_termios;
+
+    if(on == 1)
+    {
+        tio->c_cflag |= CRTSCTS;
+        return 1;
+    }
+    tio->c_cflag &= ~CRTSCTS;
+    return 0;
+}
+
+int comserial_set_xonxoff(t_comconfig *cfg, int on)
+{
+    struct termios *tio = &cfg->c_termios;
+
+    if(on == 1)
+    {
+        tio->c_iflag |= (IXON | IXOFF | IXANY);
+        return 1;
+    }
+    tio->c_iflag &= ~IXON & ~IXOFF &  ~IXANY;
+    return 0;
+}
+
+void comserial_merge(struct termios *tio, const t_comconfig *cfg, int raw)
+{
+    if(raw)
+    {
+        /* enable input and ignore modem controls */
+        tio->c_cflag |= (CREAD | CLOCAL);
+        /* always nocanonical, this means raw i/o no terminal */
+        tio->c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
+        /* don't process input */
+        if(!cfg->c_inprocess)
+            tio->c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+        /* no post processing */
+        tio->c_oflag &= ~OPOST;
+    }
+    tio->c_cflag = (tio->c_cflag & ~COMPORT_CFLAGS) | (cfg->c_termios.c_cflag & COMPORT_CFLAGS);
+    tio->c_iflag = (tio->c_iflag & ~COMPORT_IFLAGS) | (cfg->c_termios.c_iflag & COMPORT_IFLAGS);
+    cfsetispeed(tio, cfgetispeed(&cfg->c_termios));
+    cfsetospeed(tio, cfgetospeed(&cfg->c_termios));
+}
+
+/* (re)apply a rate that needs BOTHER after a tcsetattr(), 0 for none */
+static int set_custom_baudrate(int fd, int baud)
+{
+#ifdef COMPORT_TERMIOS2
+    struct termios2 tio2;
+    if(0 == baud) return 1;
+    if(ioctl(fd, TCGETS2, &tio2) < 0)
+        return 0;
+    tio2.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio2.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio2.c_ispeed = tio2.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &tio2) == 0;
+#else
+    (void)fd; (void)baud;
+    return 1;
+#endif
+}
+
+int comserial_open(const char *path)
+{
+    int fd = open(path, OPENPARAMS);
+    if(fd >= 0) /* set no wait on any operation */
+        fcntl(fd, F_SETFL, FNDELAY);
+    return fd;
+}
+
+static int comserial_apply(int fd, t_comconfig *cfg, int raw, int *speedchanged)
+{
+    struct termios  tio;
+    speed_t         was;
+
+    if(tcgetattr(fd, &tio) == -1)
+        return COMSERIAL_FAILED_GET;
+    was = cfgetospeed(&tio);
+    comserial_merge(&tio, cfg, raw);
+    if(tcsetattr(fd, TCSAFLUSH, &tio) == -1 || !set_custom_baudrate(fd, cfg->c_custom_baud))
+        return COMSERIAL_FAILED_SET;
+    cfg->c_termios = tio;
+    if(speedchanged)
+        *speedchanged = (was != cfgetospeed(&tio)) || cfg->c_custom_baud;
+    return 0;
+}
+
+int comserial_setup(int fd, t_comconfig *cfg, struct termios *old)
+{
+    if(tcgetattr(fd, old) == -1)
+        return COMSERIAL_FAILED_GET;
+    return comserial_apply(fd, cfg, 1, NULL);
+}
+
+int comserial_configure(int fd, t_comconfig *cfg, int *speedchanged)
+{
+    return comserial_apply(fd, cfg, 0, speedchanged);
+}
+
+void comserial_close(int fd, const struct termios *restore)
+{
+    if(restore)
+        tcsetattr(fd, TCSANOW, restore);
+    close(fd);
+}
+
+int comserial_openpty(int *slave, char *name, size_t size)
+{
+    int         master;
+    const char  *path = NULL;
+
+    *slave = -1;
+    if((master = posix_openpt(O_RDWR | O_NOCTTY)) == -1
+        || grantpt(master) == -1 || unlockpt(master) == -1
+        || NULL == (path = ptsname(master)))
+    {
+        int err = errno;
+        if(master != -1)
+            close(master);
+        errno = err;
+        return -1;
+    }
+    snprintf(name, size, "%s", path);
+    fcntl(master, F_SETFL, O_NONBLOCK); /* like comserial_open() */
+    /* as long as no one has the slave open, reading the master fails */
+    *slave = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    return master;
+}
+
+long comserial_get_baudrate(int fd)
+{
+#ifdef COMPORT_TERMIOS2
+    struct termios2 tio2;
+    if(ioctl(fd, TCGETS2, &tio2) == 0)
+        return tio2.c_ospeed;
+#else
+    (void)fd;
+#endif
+    return -1;
+}
+
+int comserial_set_modem(int fd, int line, int on)
+{
+    int status;
+
+    if(ioctl(fd, TIOCMGET, &status) < 0)
+        return 0;
+    if(on)
+        status |= line;
+    else
+        status &= ~line;
+    return ioctl(fd, TIOCMSET, &status) == 0;
+}
+
+int comserial_get_modem(int fd, int line)
+{
+    int status;
+
+    if(ioctl(fd, TIOCMGET, &status) < 0)
+        return -1;
+    return (status & line) != 0;
+}
+
+int comserial_set_break(int fd, int on)
+{
+    /* on: start sending zero bits, off: stop it */
+    return ioctl(fd, on ? TIOCSBRK : TIOCCBRK) == 0;
+}
+
+int comserial_set_hupcl(int fd, int on)
+{
+    struct termios settings;
+
+    if(tcgetattr(fd, &settings) < 0)
+        return 0;
+    if(on)
+        settings.c_cflag |= HUPCL;
+    else
+        settings.c_cflag &= ~HUPCL;
+    return tcsetattr(fd, TCSANOW, &settings) == 0;
+}
+
+#ifdef __linux__
+int comserial_get_lowlatency(int fd)
+{
+    struct serial_struct ss;
+
+    if(ioctl(fd, TIOCGSERIAL, &ss) < 0)
+        return -1;
+    return !!(ss.flags & ASYNC_LOW_LATENCY);
+}
+
+int comserial_set_lowlatency(int fd, int on)
+{
+    struct serial_struct ss;
+
+    if(ioctl(fd, TIOCGSERIAL, &ss) < 0)
+        return 0;
+    if(on)
+        ss.flags |= ASYNC_LOW_LATENCY;
+    else
+        ss.flags &= ~ASYNC_LOW_LATENCY;
+    return ioctl(fd, TIOCSSERIAL, &ss) == 0;
+}
+
+/* FTDI (and some other) usb-serial drivers batch input for latency_timer ms */
+static int latency_timer_path(const char *device, char *path, size_t size)
+{
+    char        real[PATH_MAX];
+    const char  *name;
+
+    if(NULL == realpath(device, real)) /* resolve by-id links */
+        return 0;
+    name = strrchr(real, '/');
+    name = name ? name + 1 : real;
+    if(snprintf(path, size, "/sys/bus/usb-serial/devices/%s/latency_timer", name) >= (int)size)
+        return 0;
+    return 0 == access(path, F_OK);
+}
+
+int comserial_get_latency_timer(const char *device)
+{
+    char    path[PATH_MAX];
+    FILE    *f;
+    int     ms = -1;
+
+    if(!latency_timer_path(device, path, sizeof(path)) || NULL == (f = fopen(path, "r")))
+        return -1;
+    if(fscanf(f, "%d", &ms) != 1)
+        ms = -1;
+    fclose(f);
+    return ms;
+}
+
+int comserial_set_latency_timer(const char *device, int ms)
+{
+    char    path[PATH_MAX];
+    FILE    *f;
+    int     ok, err;
+
+    if(!latency_timer_path(device, path, sizeof(path)))
+    {
+        errno = ENOENT;
+        return 0;
+    }
+    if(NULL == (f = fopen(path, "w")))
+        return 0;
+    ok = (fprintf(f, "%d", ms) > 0);
+    err = errno;
+    if(0 != fclose(f))
+        ok = 0;
+    else if(!ok)
+        errno = err;
+    return ok;
+}
+#else /* __linux__ */
+int comserial_get_lowlatency(int fd)
+{
+    (void)fd;
+    return -1;
+}
+
+int comserial_set_lowlatency(int fd, int on)
+{
+    (void)fd; (void)on;
+    errno = ENOTSUP;
+    return 0;
+}
+
+int comserial_get_latency_timer(const char *device)
+{
+    (void)device;
+    return -1;
+}
+
+int comserial_set_latency_timer(const char *device, int ms)
+{
+    (void)device; (void)ms;
+    errno = ENOTSUP;
+    return 0;
+}
+#endif /* __linux__ */
+
+/* device nodes are numbered in the order they show up, so after replugging,
+   /dev/ttyUSB0 might well be /dev/ttyUSB1. to find a lost device again, we
+   go by a /dev/serial/by-id link, the VID:PID or the serial number of the
+   USB device instead */
+
+#ifdef __linux__
+static int comserial_readfile(const char *dir, const char *name, char *buf, size_t size)
+{
+    char    path[PATH_MAX];
+    FILE    *f;
+    size_t  n;
+
+    if(snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)
+        || NULL == (f = fopen(path, "r")))
+        return 0;
+    n = fread(buf, 1, size - 1, f);
+    fclose(f);
+    while(n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+        n--;
+    buf[n] = 0;
+    return n > 0;
+}
+
+/* the ids of the USB device a tty belongs to; 0 if it is no USB device */
+static int comserial_usbinfo(const char *tty, char *usbid, size_t usbidsize,
+    char *serial, size_t serialsize)
+{
+    char    path[PATH_MAX], dev[PATH_MAX];
+    char    vid[16], pid[16];
+    int     i;
+
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device", tty);
+    if(NULL == realpath(path, dev))
+        return 0;
+    for(i = 0; i < 4; i++)
+    { /* ttyACM hangs off the interface, ttyUSB one level below it */
+        char *slash;
+        if(comserial_readfile(dev, "idVendor", vid, sizeof(vid))
+            && comserial_readfile(dev, "idProduct", pid, sizeof(pid)))
+        {
+            snprintf(usbid, usbidsize, "%s:%s", vid, pid);
+            if(!comserial_readfile(dev, "serial", serial, serialsize))
+                *serial = 0;
+            return 1;
+        }
+        if(NULL == (slash = strrchr(dev, '/')) || slash == dev)
+            break;
+        *slash = 0;
+    }
+    return 0;
+}
+#endif /* __linux__ */
+
+int comserial_stable_name(const char *device, char *id, size_t size)
+{
+    char            real[PATH_MAX], link[PATH_MAX], target[PATH_MAX];
+    DIR             *dir;
+    struct dirent   *e;
+    int             found = 0;
+
+    if(NULL == realpath(device, real))
+        return 0;
+    if(NULL != (dir = opendir(COMPORT_BYID_DIR)))
+    {
+        while(!found && NULL != (e = readdir(dir)))
+        {
+            if('.' == e->d_name[0]) continue;
+            snprintf(link, sizeof(link), "%s/%s", COMPORT_BYID_DIR, e->d_name);
+            if(realpath(link, target) && !strcmp(target, real))
+                found = snprintf(id, size, "%s", link) < (int)size;
+        }
+        closedir(dir);
+    }
+#ifdef __linux__
+    if(!found)
+    {
+        char        usbid[32], serial[256];
+        const char  *tty = strrchr(real, '/');
+        if(comserial_usbinfo(tty ? tty + 1 : real, usbid, sizeof(usbid), serial, sizeof(serial)))
+        {
+            snprintf(id, size, "%s", *serial ? serial : usbid);
+            found = 1;
+        }
+    }
+#endif /* __linux__ */
+    return found;
+}
+
+int comserial_find_identity(const char *id, char *path, size_t size)
+{
+    int found = 0;
+
+    if('/' == *id)
+    { /* a path, hopefully one that doesn't change */
+        if(0 != access(id, F_OK))
+            return 0;
+        snprintf(path, size, "%s", id);
+        return 1;
+    }
+#ifdef __linux__
+    {
+        DIR             *dir;
+        struct dirent   *e;
+        char            usbid[32], serial[256];
+        if(NULL == (dir = opendir("/sys/class/tty")))
+            return 0;
+        while(!found && NULL != (e = readdir(dir)))
+        {
+            if('.' == e->d_name[0]) continue;
+            if(comserial_usbinfo(e->d_name, usbid, sizeof(usbid), serial, sizeof(serial))
+                && (!strcasecmp(id, usbid) || !strcmp(id, serial)))
+            {
+                snprintf(path, size, "/dev/%s", e->d_name);
+                found = 1;
+            }
+        }
+        closedir(dir);
+    }
+#endif /* __linux__ */
+    return found;
+}
+
+long comserial_read(int fd, void *buf, size_t len, t_comstats *st)
+{
+    long n = read(fd, buf, len);
+    comstats_read(st, n);
+    return n;
+}
+
+long comserial_write(int fd, const void *buf, size_t len, t_comstats *st)
+{
+    long n = write(fd, buf, len);
+    comstats_write(st, n);
+    return n;
+}
+
+long comserial_read_ring(int fd, t_comring *r, t_comstats *st)
+{
+    size_t          len;
+    unsigned char   *buf = comring_writeptr(r, &len);
+    long            n = comserial_read(fd, buf, len, st);
+
+    if(n > 0)
+        comring_produce(r, n);
+    return n;
+}
+
+long comserial_write_ring(int fd, t_comring *r, t_comstats *st)
+{
+    const unsigned char *buf;
+    size_t              len;
+    long                total = 0;
+
+    while((buf = comring_readptr(r, &len)), len > 0)
+    {
+        long n = comserial_write(fd, buf, len, st);
+        if(n > 0)
+        {
+            comring_consume(r, n);
+            total += n;
+            if((size_t)n < len) break; /* the driver is full, keep the rest */
+        }
+        else
+        {
+            if(0 == total && n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                return -1;
+            break;
+        }
+    }
+    return total;
+}
+
+/* ------------------------------ engine ---------------------------- */
+
+#define COMENGINE_EVENTS 64 /* per epoll_wait() */
+
+/* the sources are kept in slots; the engine refers to them by slot and id,
+   so that it can tell when one has been removed while it was waiting */
+static pthread_mutex_t comengine_lock = PTHREAD_MUTEX_INITIALIZER; /* guards all of it */
+
+static struct
+{
+    pthread_t       e_thread;
+    int             e_running;
+    int             e_quit;
+    int             e_wakeup[2]; /* wakes the engine up */
+    int             e_notify[2]; /* readable while there is news */
+    t_comsource     **e_slots;
+    int             e_nslots;
+    int             e_count;
+    unsigned int    e_ids;
+    t_comsource     *e_ready; /* sources with news, oldest first */
+    t_comsource     *e_last;
+#ifdef __linux__
+    int             e_epoll;
+#else
+    int             e_changed; /* the set of polled fds has to be rebuilt */
+    struct pollfd   *e_pfd;
+    unsigned long   *e_keys; /* slot and id of each pollfd */
+    int             e_npfd;
+#endif
+} comengine;
+
+#define COMENGINE_KEY(s) (((unsigned long)(s)->s_id << 16) | (unsigned long)(s)->s_slot)
+
+static t_comsource *comengine_lookup(unsigned long key)
+{
+    int         slot = (int)(key & 0xffff);
+    t_comsource *s = (slot < comengine.e_nslots) ? comengine.e_slots[slot] : NULL;
+    if(s && s->s_id == (unsigned int)(key >> 16))
+        return s;
+    return NULL;
+}
+
+static void comengine_wake(void)
+{
+    ssize_t res = write(comengine.e_wakeup[1], "", 1);
+    (void)res;
+}
+
+/* a source is read while it is neither blocked nor dead */
+static int comengine_arm(t_comsource *s)
+{
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = COMENGINE_KEY(s);
+    return epoll_ctl(comengine.e_epoll, EPOLL_CTL_ADD, s->s_fd, &ev) == 0;
+#else
+    (void)s;
+    comengine.e_changed = 1;
+    comengine_wake();
+    return 1;
+#endif
+}
+
+static void comengine_disarm(t_comsource *s)
+{
+#ifdef __linux__
+    /* (with no events, epoll would still report hangups) */
+    epoll_ctl(comengine.e_epoll, EPOLL_CTL_DEL, s->s_fd, NULL);
+#else
+    (void)s;
+    comengine.e_changed = 1;
+    comengine_wake();
+#endif
+}
+
+static void comengine_post(t_comsource *s)
+{
+    if(s->s_ready) return;
+    s->s_ready = 1;
+    s->s_next = NULL;
+    if(comengine.e_last)
+        comengine.e_last->s_next = s;
+    else
+    {
+        ssize_t res;
+        comengine.e_ready = s;
+        res = write(comengine.e_notify[1], "", 1);
+        (void)res;
+    }
+    comengine.e_last = s;
+}
+
+/* read from a source that is readable */
+static void comengine_service(t_comsource *s)
+{
+    size_t  len;
+    long    n;
+    int     epoch;
+
+    if(s->s_blocked || s->s_status) return; /* stale event */
+    if(s->s_epoch && (epoch = comport_load_acquire(s->s_epoch)) != s->s_seen_epoch)
+    {
+        comstats_clear(s->s_stats);
+        comport_store_release(&s->s_seen_epoch, epoch);
+    }
+    comring_writeptr(s->s_ring, &len);
+    if(0 == len)
+    { /* wait for the consumer to drain it */
+        s->s_blocked = 1;
+        comengine_disarm(s);
+        comengine_post(s);
+        return;
+    }
+    n = comserial_read_ring(s->s_fd, s->s_ring, s->s_stats);
+    if(n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR)))
+    {
+        if(n > 0)
+        {
+            if(s->s_stamps)
+                comstamps_push(s->s_stamps, s->s_ring->r_head, comclock_now());
+            comengine_post(s);
+        }
+        return;
+    }
+    /* readable but nothing to read, or an error: the device is gone */
+    comport_store_release(&s->s_status, n == 0 ? -1 : (errno ? errno : -1));
+    comengine_disarm(s);
+    comengine_post(s);
+}
+
+static void *comengine_thread(void *arg)
+{
+#ifdef __linux__
+    struct epoll_event ev[COMENGINE_EVENTS];
+#endif
+    (void)arg;
+
+    pthread_mutex_lock(&comengine_lock);
+    while(!comengine.e_quit)
+    {
+        int i, n;
+#ifdef __linux__
+        pthread_mutex_unlock(&comengine_lock);
+        n = epoll_wait(comengine.e_epoll, ev, COMENGINE_EVENTS, -1);
+        pthread_mutex_lock(&comengine_lock);
+        for(i = 0; i < n; i++)
+        {
+            t_comsource *s;
+            if(ev[i].data.u64 == (uint64_t)-1)
+            {
+                char dummy[16];
+                while(read(comengine.e_wakeup[0], dummy, sizeof(dummy)) > 0);
+            }
+            else if((s = comengine_lookup((unsigned long)ev[i].data.u64)))
+                comengine_service(s);
+        }
+#else
+        if(comengine.e_changed)
+        { /* poll the wakeup pipe and every source that is armed */
+            struct pollfd *pfd = (struct pollfd *)realloc(comengine.e_pfd,
+                (comengine.e_nslots + 1) * sizeof(struct pollfd));
+            unsigned long *keys = (unsigned long *)realloc(comengine.e_keys,
+                (comengine.e_nslots + 1) * sizeof(unsigned long));
+            if(pfd) comengine.e_pfd = pfd;
+            if(keys) comengine.e_keys = keys;
+            if(!pfd || !keys)
+            { /* try again later */
+                pthread_mutex_unlock(&comengine_lock);
+                usleep(10000);
+                pthread_mutex_lock(&comengine_lock);
+                continue;
+            }
+            pfd[0].fd = comengine.e_wakeup[0];
+            pfd[0].events = POLLIN;
+            comengine.e_npfd = 1;
+            for(i = 0; i < comengine.e_nslots; i++)
+            {
+                t_comsource *s = comengine.e_slots[i];
+                if(!s || s->s_blocked || s->s_status) continue;
+                pfd[comengine.e_npfd].fd = s->s_fd;
+                pfd[comengine.e_npfd].events = POLLIN;
+                keys[comengine.e_npfd++] = COMENGINE_KEY(s);
+            }
+            comengine.e_changed = 0;
+        }
+        pthread_mutex_unlock(&comengine_lock);
+        n = poll(comengine.e_pfd, comengine.e_npfd, -1);
+        pthread_mutex_lock(&comengine_lock);
+        if(n <= 0) continue;
+        if(comengine.e_pfd[0].revents & POLLIN)
+        {
+            char dummy[16];
+            while(read(comengine.e_wakeup[0], dummy, sizeof(dummy)) > 0);
+        }
+        for(i = 1; i < comengine.e_npfd; i++)
+        {
+            t_comsource *s;
+            if(comengine.e_pfd[i].revents && (s = comengine_lookup(comengine.e_keys[i])))
+                comengine_service(s);
+        }
+#endif
+    }
+    pthread_mutex_unlock(&comengine_lock);
+    return 0;
+}
+
+static int comengine_start(void)
+{
+    if(pipe(comengine.e_wakeup) < 0)
+        return 0;
+    if(pipe(comengine.e_notify) < 0)
+        goto fail_notify;
+    fcntl(comengine.e_wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(comengine.e_wakeup[1], F_SETFL, O_NONBLOCK);
+    fcntl(comengine.e_notify[0], F_SETFL, O_NONBLOCK);
+    fcntl(comengine.e_notify[1], F_SETFL, O_NONBLOCK);
+#ifdef __linux__
+    {
+        struct epoll_event ev;
+        if((comengine.e_epoll = epoll_create1(EPOLL_CLOEXEC)) < 0)
+            goto fail_epoll;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = (uint64_t)-1;
+        if(epoll_ctl(comengine.e_epoll, EPOLL_CTL_ADD, comengine.e_wakeup[0], &ev) < 0)
+            goto fail_thread;
+    }
+#else
+    comengine.e_changed = 1;
+#endif
+    comengine.e_quit = 0;
+    if(pthread_create(&comengine.e_thread, NULL, comengine_thread, NULL) != 0)
+        goto fail_thread;
+    comengine.e_running = 1;
+    return 1;
+
+fail_thread:
+#ifdef __linux__
+    close(comengine.e_epoll);
+fail_epoll:
+#endif
+    close(comengine.e_notify[0]);
+    close(comengine.e_notify[1]);
+fail_notify:
+    close(comengine.e_wakeup[0]);
+    close(comengine.e_wakeup[1]);
+    return 0;
+}
+
+/* called without the lock, once the last source is gone */
+static void comengine_stop(void)
+{
+    pthread_mutex_lock(&comengine_lock);
+    comengine.e_quit = 1;
+    comengine_wake();
+    pthread_mutex_unlock(&comengine_lock);
+    pthread_join(comengine.e_thread, NULL);
+    comengine.e_running = 0;
+#ifdef __linux__
+    close(comengine.e_epoll);
+#else
+    free(comengine.e_pfd);
+    free(comengine.e_keys);
+    comengine.e_pfd = NULL;
+    comengine.e_keys = NULL;
+    comengine.e_npfd = 0;
+#endif
+    close(comengine.e_notify[0]);
+    close(comengine.e_notify[1]);
+    close(comengine.e_wakeup[0]);
+    close(comengine.e_wakeup[1]);
+    free(comengine.e_slots);
+    comengine.e_slots = NULL;
+    comengine.e_nslots = 0;
+}
+
+int comengine_add(t_comsource *s)
+{
+    int slot;
+
+    pthread_mutex_lock(&comengine_lock);
+    if(!comengine.e_running && !comengine_start())
+        goto fail;
+    for(slot = 0; slot < comengine.e_nslots; slot++)
+        if(!comengine.e_slots[slot]) break;
+    if(slot == comengine.e_nslots)
+    {
+        int         n = comengine.e_nslots ? comengine.e_nslots * 2 : 16;
+        t_comsource **slots;
+        if(n > 0x10000 || NULL == (slots = (t_comsource **)realloc(comengine.e_slots, n * sizeof(*slots))))
+        {
+            errno = ENOMEM;
+            goto fail;
+        }
+        memset(slots + comengine.e_nslots, 0, (n - comengine.e_nslots) * sizeof(*slots));
+        comengine.e_slots = slots;
+        comengine.e_nslots = n;
+    }
+    if(++comengine.e_ids > 0xffffffffUL >> 16) comengine.e_ids = 1;
+    s->s_id = comengine.e_ids;
+    s->s_slot = slot;
+    s->s_status = 0;
+    s->s_seen_epoch = s->s_epoch ? comport_load_acquire(s->s_epoch) : 0;
+    s->s_ready = s->s_blocked = 0;
+    s->s_next = NULL;
+    if(!comengine_arm(s))
+        goto fail;
+    comengine.e_slots[slot] = s;
+    comengine.e_count++;
+    pthread_mutex_unlock(&comengine_lock);
+    return 1;
+
+fail:
+    {
+        int running = comengine.e_running && !comengine.e_count, err = errno;
+        pthread_mutex_unlock(&comengine_lock);
+        if(running)
+            comengine_stop();
+        errno = err;
+    }
+    return 0;
+}
+
+void comengine_remove(t_comsource *s)
+{
+    int last;
+
+    pthread_mutex_lock(&comengine_lock);
+    if(s->s_slot >= comengine.e_nslots || comengine.e_slots[s->s_slot] != s)
+    {
+        pthread_mutex_unlock(&comengine_lock);
+        return;
+    }
+    if(!s->s_blocked && !s->s_status)
+        comengine_disarm(s);
+    comengine.e_slots[s->s_slot] = NULL;
+    if(s->s_ready)
+    { /* take it out of the list */
+        t_comsource **p = &comengine.e_ready, *prev = NULL;
+        while(*p != s)
+        {
+            prev = *p;
+            p = &(*p)->s_next;
+        }
+        *p = s->s_next;
+        if(comengine.e_last == s)
+            comengine.e_last = prev;
+        s->s_ready = 0;
+    }
+    last = (--comengine.e_count == 0);
+    pthread_mutex_unlock(&comengine_lock);
+    if(last)
+        comengine_stop();
+}
+
+int comengine_count(void)
+{
+    int n;
+    pthread_mutex_lock(&comengine_lock);
+    n = comengine.e_count;
+    pthread_mutex_unlock(&comengine_lock);
+    return n;
+}
+
+int comengine_fd(void)
+{
+    return comengine.e_running ? comengine.e_notify[0] : -1;
+}
+
+t_comsource *comengine_next(void)
+{
+    t_comsource *s;
+
+    pthread_mutex_lock(&comengine_lock);
+    if((s = comengine.e_ready))
+    {
+        comengine.e_ready = s->s_next;
+        if(!comengine.e_ready)
+            comengine.e_last = NULL;
+        s->s_ready = 0;
+        s->s_next = NULL;
+    }
+    if(!comengine.e_ready && comengine.e_running)
+    { /* nothing left: the next post() writes again */
+        char dummy[16];
+        while(read(comengine.e_notify[0], dummy, sizeof(dummy)) > 0);
+    }
+    pthread_mutex_unlock(&comengine_lock);
+    return s;
+}
+
+void comengine_resume(t_comsource *s)
+{
+    pthread_mutex_lock(&comengine_lock);
+    if(s->s_blocked && s->s_slot < comengine.e_nslots && comengine.e_slots[s->s_slot] == s)
+    {
+        s->s_blocked = 0;
+        if(!comengine_arm(s))
+            s->s_status = errno ? errno : -1;
+    }
+    pthread_mutex_unlock(&comengine_lock);
+}
+
+#endif /* !_WIN32 */
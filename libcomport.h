@@ -0,0 +1,416 @@
+/* libcomport - the serial engine of [comport], without Pd
+
+ (c) 1998-2005  Winfried Ritsch (see LICENCE.txt)
+ Institute for Electronic Music - Graz
+
+ everything [comport] does with a serial device that doesn't need Pd:
+
+   t_comring       single-producer/single-consumer lock-free byte ring
+   t_comstats      I/O counters
+   t_comstamps     when the bytes in a ring arrived
+   t_comsched      payloads waiting for the time they are due
+   t_comframer     reassembly of received bytes into frames
+   t_comfield      binary records described by format strings
+   t_comcheck      CRCs and checksums of frames
+   comserial_...   opening, configuring, reading and writing devices (POSIX;
+                   on Windows, [comport] still talks to the Win32 API itself)
+   comengine_...   one thread that reads all devices that are added to it (POSIX)
+
+ nothing in here calls into Pd, so it can be linked into other programs
+ (e.g. libpd based apps) or benchmarked on its own. the comserial_...
+ functions keep no state and can be called from any thread; they return
+ nonzero on success and 0 (with errno set) on failure unless noted.
+*/
+
+#ifndef LIBCOMPORT_H
+#define LIBCOMPORT_H
+
+#include <stddef.h>
+#ifndef _WIN32
+#include <termios.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* atomic accessors for the indices of ring buffers (and other counters)
+   that are shared between threads */
+#if defined(__GNUC__) || defined(__clang__)
+# define comport_load_acquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define comport_store_release(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#else
+# define comport_load_acquire(ptr) (*(ptr))
+# define comport_store_release(ptr, val) (*(ptr) = (val))
+#endif
+
+/* ------------------------------ ring ------------------------------ */
+
+/* single-producer/single-consumer lock-free ring buffer */
+typedef struct comring
+{
+    unsigned char   *r_buf;
+    size_t          r_size; /* always a power of 2 */
+    size_t          r_head; /* total bytes written, only modified by the producer */
+    size_t          r_tail; /* total bytes read, only modified by the consumer */
+} t_comring;
+
+int comring_init(t_comring *r, size_t minsize);
+void comring_free(t_comring *r);
+/* producer side: get the contiguous free region, then publish what was written */
+unsigned char *comring_writeptr(t_comring *r, size_t *len);
+void comring_produce(t_comring *r, size_t len);
+/* consumer side: get the contiguous filled region, then release what was read */
+const unsigned char *comring_readptr(t_comring *r, size_t *len);
+void comring_consume(t_comring *r, size_t len);
+/* number of bytes that are in the ring */
+size_t comring_used(t_comring *r);
+/* producer side: write a byte 'offset' bytes behind the head without
+   publishing it (0 if it doesn't fit), resp. overwrite such a byte */
+int comring_stage(t_comring *r, size_t offset, unsigned char c);
+void comring_patch(t_comring *r, size_t offset, unsigned char c);
+/* consumer side: drop everything */
+void comring_flush(t_comring *r);
+
+/* ------------------------------ stats ----------------------------- */
+
+/* I/O counters, each set is only ever written by one thread */
+typedef struct comstats
+{
+    unsigned long   s_rxbytes;
+    unsigned long   s_txbytes;
+    unsigned long   s_reads; /* read syscalls */
+    unsigned long   s_writes; /* write syscalls */
+    unsigned long   s_maxread; /* largest single read */
+    unsigned long   s_timed; /* payloads written when they were due */
+    long            s_latesum; /* ...how late that was, usec (negative if early) */
+    long            s_latemin;
+    long            s_latemax;
+} t_comstats;
+
+void comstats_clear(t_comstats *st);
+/* count a read or write syscall that returned n */
+void comstats_read(t_comstats *st, long n);
+void comstats_write(t_comstats *st, long n);
+/* count a payload that was due 'ms' ago when it was written */
+void comstats_late(t_comstats *st, double ms);
+
+/* ---------------------------- timestamps -------------------------- */
+
+/* milliseconds of a monotonic clock (CLOCK_MONOTONIC) */
+double comclock_now(void);
+
+/* when the bytes of a ring arrived: after each read, the producer notes the
+   head of the ring and the time, the consumer looks up the bytes it takes.
+   single-producer/single-consumer like the ring */
+typedef struct comstamps
+{
+    double          *t_time;
+    size_t          *t_end; /* r_head of the ring after that read */
+    size_t          t_size; /* always a power of 2, 0 if not in use */
+    size_t          t_head;
+    size_t          t_tail;
+} t_comstamps;
+
+int comstamps_init(t_comstamps *t, size_t minsize);
+void comstamps_free(t_comstamps *t);
+/* producer side: the bytes up to 'end' arrived at 'time' (dropped if full) */
+void comstamps_push(t_comstamps *t, size_t end, double time);
+/* consumer side: when did the byte at 'pos' arrive? 0 if unknown, else
+   1 with the time and the end of the bytes that arrived with it */
+int comstamps_find(t_comstamps *t, size_t pos, double *time, size_t *end);
+/* consumer side: forget everything (e.g. when the ring starts over) */
+void comstamps_flush(t_comstamps *t);
+
+/* ---------------------------- scheduling -------------------------- */
+
+/* a payload that is to be written at a time of comclock_now() */
+typedef struct comtimed
+{
+    struct comtimed *t_next;
+    double          t_due;
+    size_t          t_len;
+    unsigned char   t_data[1]; /* really t_len bytes */
+} t_comtimed;
+
+/* payloads in the order they are due (same times in the order they were
+   added). not thread-safe: whoever shares it must lock around it */
+typedef struct comsched
+{
+    t_comtimed      *s_head;
+    t_comtimed      *s_tail;
+    size_t          s_count;
+    size_t          s_bytes; /* sum of their t_len */
+} t_comsched;
+
+void comsched_init(t_comsched *s);
+/* 0 if out of memory */
+int comsched_add(t_comsched *s, double due, const unsigned char *buf, size_t len);
+/* when the first one is due, 0 if there is none */
+int comsched_next(const t_comsched *s, double *due);
+/* remove the first one if it is due at 'now', the caller frees it */
+t_comtimed *comsched_take(t_comsched *s, double now);
+void comtimed_free(t_comtimed *t);
+/* drop them all, returns how many bytes that were */
+size_t comsched_clear(t_comsched *s);
+
+/* ----------------------------- framing ---------------------------- */
+
+#define COMPORT_FRAME_NONE 0
+#define COMPORT_FRAME_DELIMITER 1 /* frames end with a byte sequence */
+#define COMPORT_FRAME_MARKERS 2 /* frames are enclosed in a start and an end byte */
+#define COMPORT_FRAME_FIXED 3 /* all frames have the same size */
+#define COMPORT_FRAME_LENGTH 4 /* frames carry their payload length */
+#define COMPORT_FRAME_SLIP 5 /* RFC 1055 */
+#define COMPORT_FRAME_COBS 6 /* consistent overhead byte stuffing, 0-delimited */
+#define COMPORT_FRAME_HDLC 7 /* async HDLC byte stuffing (RFC 1662), without FCS;
+                                  [comport] escapes 0x00-0x1F when sending */
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+#define HDLC_FLAG 0x7E
+#define HDLC_ESC 0x7D
+#define HDLC_XOR 0x20
+
+#define COMPORT_MAXDELIM 8
+
+typedef void (*t_comframe_fn)(void *owner, const unsigned char *frame, int len);
+
+typedef struct comframer
+{
+    int             f_type; /* COMPORT_FRAME_... */
+    unsigned char   f_delim[COMPORT_MAXDELIM]; /* delimiter sequence, resp. start and end marker */
+    int             f_delim_len;
+    int             f_fixed; /* size of fixed frames */
+    int             f_len_offset; /* position of the length field */
+    int             f_len_size; /* size of the length field (1, 2 or 4 bytes) */
+    int             f_len_adjust; /* added to the length field's value */
+    char            f_len_bigendian;
+    unsigned char   *f_buf; /* the frame under construction */
+    int             f_max; /* size of f_buf, frames cannot grow bigger */
+    int             f_fill;
+    char            f_inside; /* markers: start marker seen */
+    char            f_skipping; /* overflow or bad data: drop everything up to the next delimiter */
+    char            f_escape; /* SLIP/HDLC: the last byte was an escape */
+    int             f_errors; /* number of frames dropped */
+} t_comframer;
+
+/* (re)allocate the frame buffer, this drops any partial frame */
+int comframer_setmax(t_comframer *f, int max);
+void comframer_free(t_comframer *f);
+/* feed received bytes into the framer, fn() is called for each complete frame.
+   partial frames are kept until the next call. fn() may call comframer_setmax()
+   or comframer_free(), the rest of the bytes then go to the new framing
+   (or are dropped) */
+void comframer_push(t_comframer *f, const unsigned char *buf, int len,
+    t_comframe_fn fn, void *owner);
+
+/* ----------------------------- records ---------------------------- */
+
+/* binary records are described by format strings, e.g. "<hhhf":
+     <  little endian (the default)     >  or  !  big endian
+     b B   8 bit signed/unsigned integer
+     h H  16 bit
+     i I  32 bit
+     q Q  64 bit
+     f d  32/64 bit IEEE float
+     x     a pad byte (no value)
+   a count in front repeats a field ("3h" is "hhh"). an integer can be
+   split into bitfields of the given widths, starting at the least
+   significant bit: "H:4:4:8" is three values (unused high bits are ignored,
+   bitfields of signed types are sign-extended). */
+#define COMFIELD_MAXBITS 64
+
+typedef struct comfield
+{
+    char            f_type; /* the format character */
+    char            f_bigendian;
+    int             f_size; /* in bytes */
+    int             f_nbits; /* number of bitfields, 0 for a plain value */
+    unsigned char   f_bits[COMFIELD_MAXBITS]; /* their widths */
+} t_comfield;
+
+typedef struct comformat
+{
+    const char      *m_next; /* the rest of the format string */
+    char            m_bigendian;
+    int             m_repeat; /* how often m_field is still to come */
+    t_comfield      m_field;
+} t_comformat;
+
+void comformat_init(t_comformat *m, const char *fmt);
+/* get the next field: returns 1, 0 at the end of the format or -1 on a
+   syntax error (m->m_next points at it) */
+int comformat_next(t_comformat *m, t_comfield *f);
+/* the size in bytes, number of fields and values of a whole format;
+   returns 0 on a syntax error */
+int comformat_measure(const char *fmt, int *size, int *nfields, int *nvalues);
+
+/* the number of values a field stands for */
+#define comfield_nvalues(f) ((f)->f_type == 'x' ? 0 : (f)->f_nbits ? (f)->f_nbits : 1)
+/* the raw bits of a field in a record, resp. write them to it */
+unsigned long long comfield_load(const t_comfield *f, const unsigned char *p);
+void comfield_store(const t_comfield *f, unsigned long long raw, unsigned char *p);
+/* the i-th value in the raw bits, resp. set it (integers are truncated
+   towards zero and clamped to the range of the field) */
+double comfield_value(const t_comfield *f, unsigned long long raw, int i);
+unsigned long long comfield_setvalue(const t_comfield *f, unsigned long long raw,
+    int i, double v);
+
+/* ---------------------------- checksums --------------------------- */
+
+/* the checksums that are known by name (check value of "123456789"):
+     crc8          CRC-8/SMBUS      0xF4
+     crc8maxim     CRC-8/MAXIM      0xA1   (Dallas 1-Wire)
+     crc16modbus   CRC-16/MODBUS    0x4B37 (sent low byte first)
+     crc16ccitt    CRC-16/CCITT-FALSE 0x29B1
+     crc16xmodem   CRC-16/XMODEM    0x31C3
+     crc16x25      CRC-16/X-25      0x906E (the FCS of HDLC, low byte first)
+     crc32         CRC-32           0xCBF43926 (low byte first)
+     xor           XOR of all bytes
+     sum8          sum of all bytes, modulo 256
+     lrc           the two's complement of that (Modbus ASCII)
+   reflected CRCs are sent low byte first, the others high byte first.
+   CRCs are computed 8 bytes at a time (slice-by-8), the tables are built
+   by the first comcheck_find() of an algorithm, so call that from one
+   thread before sharing it. */
+typedef struct comcheck t_comcheck;
+
+/* NULL if the name is unknown or the tables can't be allocated */
+const t_comcheck *comcheck_find(const char *name);
+/* the names, separated by ", " */
+const char *comcheck_names(void);
+/* the number of bytes the checksum takes (1, 2 or 4) */
+int comcheck_size(const t_comcheck *c);
+/* checksum data in pieces: start, update with each, then write the
+   checksum (comcheck_size() bytes) to 'sum' */
+unsigned long comcheck_start(const t_comcheck *c);
+unsigned long comcheck_update(const t_comcheck *c, unsigned long state,
+    const unsigned char *buf, size_t len);
+void comcheck_finish(const t_comcheck *c, unsigned long state, unsigned char *sum);
+/* nonzero if the last comcheck_size() bytes of buf are the checksum of the rest */
+int comcheck_verify(const t_comcheck *c, const unsigned char *buf, size_t len);
+
+/* ----------------------------- devices ---------------------------- */
+#ifndef _WIN32
+
+/* what failed, see comserial_setup() */
+#define COMSERIAL_FAILED_OPEN 1
+#define COMSERIAL_FAILED_GET 2
+#define COMSERIAL_FAILED_SET 3
+
+/* how a device is to be set up */
+typedef struct comconfig
+{
+    struct termios  c_termios; /* the line settings, see comserial_set_...() */
+    int             c_custom_baud; /* a rate that needs termios2/BOTHER, 0 for none */
+    int             c_inprocess; /* leave the driver's input processing on */
+} t_comconfig;
+
+/* edit the settings; each returns what was actually set */
+long comserial_set_baudrate(t_comconfig *cfg, long baud); /* the closest supported rate */
+int comserial_set_databits(t_comconfig *cfg, int bits); /* 5, 6, 7 or 8 (default) */
+int comserial_set_parity(t_comconfig *cfg, int parity); /* 1 even, -1 odd, 0 none */
+int comserial_set_stopbits(t_comconfig *cfg, int two); /* 1 for a second stop bit */
+int comserial_set_rtscts(t_comconfig *cfg, int on);
+int comserial_set_xonxoff(t_comconfig *cfg, int on);
+/* the raw mode [comport] has always used, with the settings above taken
+   from 'cfg'. 'raw' is for freshly opened devices, a reconfiguration leaves
+   the rest alone */
+void comserial_merge(struct termios *tio, const t_comconfig *cfg, int raw);
+
+/* open a device non-blocking, returns the fd or -1 */
+int comserial_open(const char *path);
+/* save the settings of a freshly opened device to 'old' and set it up;
+   returns 0 or COMSERIAL_FAILED_... (with errno set) */
+int comserial_setup(int fd, t_comconfig *cfg, struct termios *old);
+/* apply cfg to an open device, cfg->c_termios is set to what was applied;
+   returns 0 or COMSERIAL_FAILED_... (with errno set). *speedchanged tells
+   if the line speed (might have) changed */
+int comserial_configure(int fd, t_comconfig *cfg, int *speedchanged);
+/* restore the settings and close, this can block until the output is drained */
+void comserial_close(int fd, const struct termios *restore);
+/* a pseudo-terminal: returns the master, *slave is opened too (so that the
+   master doesn't see a hangup before a peer opens it), 'name' is its path */
+int comserial_openpty(int *slave, char *name, size_t size);
+
+/* the rate the driver actually uses, -1 if it doesn't tell */
+long comserial_get_baudrate(int fd);
+/* modem lines (TIOCM_DTR, TIOCM_RTS, TIOCM_CTS, TIOCM_LE...);
+   the getter returns -1 on failure */
+int comserial_set_modem(int fd, int line, int on);
+int comserial_get_modem(int fd, int line);
+int comserial_set_break(int fd, int on);
+int comserial_set_hupcl(int fd, int on);
+/* ASYNC_LOW_LATENCY (Linux only): the getter returns -1 if unknown, the setter
+   fails with ENOTTY for devices without serial_struct (ptys, CDC devices) */
+int comserial_get_lowlatency(int fd);
+int comserial_set_lowlatency(int fd, int on);
+/* the latency timer of FTDI (and some other) usb-serial devices (Linux only);
+   -1 if the device has none */
+int comserial_get_latency_timer(const char *device);
+int comserial_set_latency_timer(const char *device, int ms);
+
+/* the name of a device that is least likely to change when it is replugged:
+   a /dev/serial/by-id link, its USB serial number or VID:PID */
+int comserial_stable_name(const char *device, char *id, size_t size);
+/* the device node that currently has such a name */
+int comserial_find_identity(const char *id, char *path, size_t size);
+
+/* read()/write() that keep count; they return what the syscall returned */
+long comserial_read(int fd, void *buf, size_t len, t_comstats *st);
+long comserial_write(int fd, const void *buf, size_t len, t_comstats *st);
+/* read into the free space of a ring (producer side) */
+long comserial_read_ring(int fd, t_comring *r, t_comstats *st);
+/* write as much of a ring as the device takes (consumer side). returns the
+   number of bytes written, or -1 if nothing was written because of an error
+   other than EAGAIN/EINTR */
+long comserial_write_ring(int fd, t_comring *r, t_comstats *st);
+
+/* ------------------------------ engine ---------------------------- */
+
+/* one thread that reads any number of devices into their rings, with epoll
+   on Linux and poll() elsewhere: idle devices cost nothing, busy ones a
+   read() each. it starts with the first source and stops with the last.
+   the consumer (one thread) learns about sources with news, i.e. data or
+   a lost device, by polling comengine_fd() and calling comengine_next() */
+typedef struct comsource
+{
+    int                 s_fd;
+    t_comring           *s_ring; /* the engine is its producer */
+    t_comstats          *s_stats; /* ...and only it counts here */
+    const int           *s_epoch; /* s_stats is cleared with the next read when this changes */
+    void                *s_owner;
+    t_comstamps         *s_stamps; /* when the reads happened, NULL if not wanted */
+    /* set by the engine */
+    int                 s_status; /* 0 (ok), -1 (lost device) or errno; it isn't read anymore */
+    unsigned int        s_id;
+    int                 s_slot;
+    int                 s_seen_epoch;
+    int                 s_ready; /* in the list of sources with news */
+    int                 s_blocked; /* not read while its ring is full */
+    struct comsource    *s_next;
+} t_comsource;
+
+/* add a source with s_fd, s_ring, s_stats, s_epoch, s_owner and s_stamps filled in */
+int comengine_add(t_comsource *s);
+/* once this returns, the engine doesn't touch the source anymore */
+void comengine_remove(t_comsource *s);
+/* number of sources */
+int comengine_count(void);
+/* readable while there are sources with news (-1 if the engine isn't running) */
+int comengine_fd(void);
+/* the next source with news, NULL if there are none (left) */
+t_comsource *comengine_next(void);
+/* the consumer has made room in the ring of a source */
+void comengine_resume(t_comsource *s);
+
+#endif /* !_WIN32 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCOMPORT_H */